@@ -1,11 +1,20 @@
+#define _GNU_SOURCE          /* pread, pwrite, ftruncate and affinity */
+#define _FILE_OFFSET_BITS 64 /* files past 2GB */
+
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 const unsigned int DEFAULT_SEED = 1234U;
 const int DEFAULT_RANGE = 10000000;
@@ -13,7 +22,7 @@ const int DEFAULT_THRESHOLD = 10;
 
 const int INT_RADIX_BASE = 10;
 
-typedef int (*pivot_func)(int[], int);
+typedef int (*pivot_func)(int[], int, unsigned int *);
 typedef int (*partition_func)(int[], int, int);
 typedef void (*finished_func)(int[], int);
 typedef struct partition_ {
@@ -36,6 +45,7 @@ typedef struct sorter_ {
   Pivot pivot;
   Partition partition;
   Callback callback;
+  unsigned int *seed; /* rand_r state of the random pivot */
 } QuickSorter;
 
 /* === Utility Methods === */
@@ -122,7 +132,7 @@ int hoare(int arr[], int len, int pivot) {
 
 /* === Pivots === */
 
-int median(int arr[], int len) {
+int median(int arr[], int len, unsigned int *seed) {
   int lo = 0;
   int hi = len - 1;
   int mid = (hi + lo) / 2;
@@ -141,10 +151,11 @@ int median(int arr[], int len) {
   return arr[lo];
 }
 
-int first(int arr[], int len) { return arr[0]; }
+int first(int arr[], int len, unsigned int *seed) { return arr[0]; }
 
-int rand_pivot(int arr[], int len) {
-  swap(&arr[0], &arr[rand() % len]);
+/* rand_r, as rand() takes a lock shared by every sorting thread */
+int rand_pivot(int arr[], int len, unsigned int *seed) {
+  swap(&arr[0], &arr[rand_r(seed) % len]);
   return arr[0];
 }
 
@@ -157,9 +168,12 @@ Partition partitions[2] = {{hoare, "Hoare"}, {lomuto, "Lomuto"}};
 Callback callbacks[2] = {{Id, 2, "No Callback"},
                          {InsertionSort, 10, "Insertion Sort"}};
 
+/* Pivot state of the sorts run on the main thread */
+unsigned int pivot_seed = DEFAULT_SEED;
+
 void QuickSort(int arr[], int len, QuickSorter config, bool toplevel) {
   if (len >= config.callback.threshold) {
-    int pivot = config.pivot.func(arr, len);
+    int pivot = config.pivot.func(arr, len, config.seed);
     int p = config.partition.func(arr, len, pivot);
     QuickSort(arr, p, config, false);
     QuickSort(arr + p + 1, len - p - 1, config, false);
@@ -169,18 +183,759 @@ void QuickSort(int arr[], int len, QuickSorter config, bool toplevel) {
   }
 }
 
+/* === External sort === */
+
+/*
+ * Sorts a binary file of native ints that may be larger than memory.
+ * Phase 1 cuts the input into RAM sized runs and sorts each with
+ * QuickSort, reading the next run and writing the previous one on their
+ * own threads meanwhile. Phase 2 merges all runs at once through a loser
+ * tree, refilling each run with large reads and writing the output in
+ * large blocks on a writer thread.
+ */
+
+/* Ints per output block of the merge */
+#define MERGE_BLOCK (1 << 21)
+
+/* Smallest per run read buffer of the merge, in ints */
+#define MERGE_MIN_BUFFER (1 << 14)
+
+double now_seconds(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+double gb_per_sec(double bytes, double seconds) {
+  return seconds > 0 ? bytes / seconds / 1e9 : 0;
+}
+
+/* Reads up to `len` bytes at `offset`, returning the bytes read or -1. */
+ssize_t read_at(int fd, void *buf, size_t len, off_t offset) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t got = pread(fd, (char *)buf + done, len - done,
+                        offset + (off_t)done);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got < 0) {
+      return -1;
+    }
+    if (got == 0) {
+      break;
+    }
+    done += (size_t)got;
+  }
+  return (ssize_t)done;
+}
+
+/* Writes all `len` bytes at `offset`, returning 0 or -1. */
+int write_at(int fd, const void *buf, size_t len, off_t offset) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t put = pwrite(fd, (const char *)buf + done, len - done,
+                         offset + (off_t)done);
+    if (put < 0 && errno == EINTR) {
+      continue;
+    }
+    if (put <= 0) {
+      return -1;
+    }
+    done += (size_t)put;
+  }
+  return 0;
+}
+
+/* One read or write on its own thread, timed. */
+typedef struct transfer_ {
+  int fd;
+  int *buf;
+  size_t len; /* ints */
+  off_t offset;
+  bool write;
+  int status;
+  double seconds;
+  pthread_t thread;
+} Transfer;
+
+void *run_transfer(void *arg) {
+  Transfer *t = arg;
+  double start = now_seconds();
+  size_t bytes = t->len * sizeof(int);
+  if (t->write) {
+    t->status = write_at(t->fd, t->buf, bytes, t->offset);
+  } else {
+    t->status = read_at(t->fd, t->buf, bytes, t->offset) ==
+                        (ssize_t)bytes
+                    ? 0
+                    : -1;
+  }
+  t->seconds = now_seconds() - start;
+  return NULL;
+}
+
+void start_transfer(Transfer *t, int fd, int *buf, size_t len,
+                    off_t offset, bool write) {
+  *t = (Transfer){
+      .fd = fd, .buf = buf, .len = len, .offset = offset, .write = write};
+  pthread_create(&t->thread, NULL, run_transfer, t);
+}
+
+/* Waits for `t`, adding its time to `seconds`. Exits on I/O errors. */
+void finish_transfer(Transfer *t, double *seconds) {
+  pthread_join(t->thread, NULL);
+  if (t->status != 0) {
+    perror(t->write ? "write" : "read");
+    exit(EXIT_FAILURE);
+  }
+  *seconds += t->seconds;
+}
+
+/* Sums that match for any permutation of the same ints. */
+typedef struct checksum_ {
+  uint64_t sum;
+  uint64_t squares;
+} Checksum;
+
+void checksum_add(Checksum *c, const int *arr, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    uint64_t v = (uint64_t)(uint32_t)arr[i];
+    c->sum += v;
+    c->squares += v * v;
+  }
+}
+
+/*
+ * Phase 1: sorts `runs` runs of at most `run_len` ints from `in` into
+ * `tmp`, run r at int offset r * run_len. Three buffers rotate between
+ * reading run r + 1, sorting run r and writing run r - 1.
+ */
+void form_runs(int in, int tmp, size_t total, size_t run_len,
+               size_t runs, QuickSorter config, Checksum *input) {
+  int *bufs[3];
+  for (int b = 0; b < 3; b++) {
+    bufs[b] = malloc(run_len * sizeof(int));
+    if (bufs[b] == NULL) {
+      perror("malloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  double read_time = 0;
+  double sort_time = 0;
+  double write_time = 0;
+  double start = now_seconds();
+  Transfer reader;
+  Transfer writer;
+  bool writing = false;
+
+  start_transfer(&reader, in, bufs[0], total < run_len ? total : run_len,
+                 0, false);
+  for (size_t r = 0; r < runs; r++) {
+    size_t begin = r * run_len;
+    size_t len = total - begin < run_len ? total - begin : run_len;
+    int *buf = bufs[r % 3];
+    finish_transfer(&reader, &read_time);
+
+    if (r + 1 < runs) {
+      size_t next = begin + run_len;
+      size_t next_len = total - next < run_len ? total - next : run_len;
+      start_transfer(&reader, in, bufs[(r + 1) % 3], next_len,
+                     (off_t)(next * sizeof(int)), false);
+    }
+
+    double sort_start = now_seconds();
+    checksum_add(input, buf, len);
+    QuickSort(buf, (int)len, config, true);
+    sort_time += now_seconds() - sort_start;
+
+    if (writing) {
+      finish_transfer(&writer, &write_time);
+    }
+    start_transfer(&writer, tmp, buf, len, (off_t)(begin * sizeof(int)),
+                   true);
+    writing = true;
+  }
+  if (writing) {
+    finish_transfer(&writer, &write_time);
+  }
+
+  double bytes = (double)total * sizeof(int);
+  double elapsed = now_seconds() - start;
+  fprintf(stderr,
+          "runs:  %zu runs, %.2f GB in %.3fs: %.3f GB/s "
+          "(read %.3f, sort %.3f, write %.3f GB/s)\n",
+          runs, bytes / 1e9, elapsed, gb_per_sec(bytes, elapsed),
+          gb_per_sec(bytes, read_time), gb_per_sec(bytes, sort_time),
+          gb_per_sec(bytes, write_time));
+  for (int b = 0; b < 3; b++) {
+    free(bufs[b]);
+  }
+}
+
+/* A sorted run being merged, buffered in `cap` int reads. */
+typedef struct merge_run_ {
+  int *buf;
+  size_t len; /* ints in buf */
+  size_t pos; /* next int in buf */
+  size_t cap;
+  off_t next; /* file offset of the next read, in ints */
+  off_t end;  /* file offset one past the run, in ints */
+} MergeRun;
+
+/* Refills `run` from `fd`, returning false once it is exhausted. */
+bool refill(int fd, MergeRun *run, double *read_time) {
+  if (run->next >= run->end) {
+    run->len = run->pos = 0;
+    return false;
+  }
+  size_t len = (size_t)(run->end - run->next);
+  if (len > run->cap) {
+    len = run->cap;
+  }
+  double start = now_seconds();
+  ssize_t bytes = (ssize_t)(len * sizeof(int));
+  if (read_at(fd, run->buf, len * sizeof(int),
+              run->next * (off_t)sizeof(int)) != bytes) {
+    perror("read");
+    exit(EXIT_FAILURE);
+  }
+  *read_time += now_seconds() - start;
+  run->next += (off_t)len;
+  run->len = len;
+  run->pos = 0;
+  return true;
+}
+
+/*
+ * Loser tree over k runs: node t > 0 holds the run that lost the match
+ * at t, node 0 the overall winner. Leaf k is a virtual run below every
+ * value, used to fill the tree at first. Exhausted runs are above every
+ * value, so an exhausted winner means the merge is done.
+ */
+bool run_less(const MergeRun *runs, int k, int a, int b) {
+  if (a == k || b == k) {
+    return a == k && b != k;
+  }
+  bool a_done = runs[a].pos >= runs[a].len;
+  bool b_done = runs[b].pos >= runs[b].len;
+  if (a_done || b_done) {
+    return !a_done;
+  }
+  return runs[a].buf[runs[a].pos] < runs[b].buf[runs[b].pos];
+}
+
+/* Replays the matches from leaf `s` up to the root. */
+void loser_adjust(int tree[], const MergeRun *runs, int k, int s) {
+  for (int t = (s + k) / 2; t > 0; t /= 2) {
+    if (run_less(runs, k, tree[t], s)) {
+      int loser = s;
+      s = tree[t];
+      tree[t] = loser;
+    }
+  }
+  tree[0] = s;
+}
+
+/*
+ * Phase 2: merges the runs of `tmp` into `out`. The output is written in
+ * MERGE_BLOCK blocks from two buffers, one filling while the writer
+ * thread writes the other.
+ */
+void merge_runs(int tmp, int out, size_t total, size_t run_len,
+                size_t runs, Checksum *output) {
+  int k = (int)runs;
+  size_t cap = 2 * run_len / runs;
+  if (cap < MERGE_MIN_BUFFER) {
+    cap = MERGE_MIN_BUFFER;
+  }
+  MergeRun *merge = calloc(runs, sizeof(MergeRun));
+  int *tree = malloc((runs + 1) * sizeof(int));
+  int *blocks[2] = {malloc(MERGE_BLOCK * sizeof(int)),
+                    malloc(MERGE_BLOCK * sizeof(int))};
+  if (merge == NULL || tree == NULL || blocks[0] == NULL ||
+      blocks[1] == NULL) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+
+  double read_time = 0;
+  double write_time = 0;
+  double start = now_seconds();
+  for (int r = 0; r < k; r++) {
+    merge[r].cap = cap;
+    merge[r].buf = malloc(cap * sizeof(int));
+    if (merge[r].buf == NULL) {
+      perror("malloc");
+      exit(EXIT_FAILURE);
+    }
+    merge[r].next = (off_t)(r * run_len);
+    merge[r].end = (off_t)((size_t)r * run_len + run_len < total
+                               ? (size_t)r * run_len + run_len
+                               : total);
+    refill(tmp, &merge[r], &read_time);
+  }
+  for (int t = 0; t <= k; t++) {
+    tree[t] = k;
+  }
+  for (int r = k - 1; r >= 0; r--) {
+    loser_adjust(tree, merge, k, r);
+  }
+
+  Transfer writer;
+  bool writing = false;
+  size_t written = 0;
+  int block = 0;
+  size_t fill = 0;
+  while (true) {
+    int w = tree[0];
+    MergeRun *run = &merge[w];
+    if (run->pos >= run->len) {
+      break;
+    }
+    blocks[block][fill++] = run->buf[run->pos++];
+    if (run->pos == run->len) {
+      refill(tmp, run, &read_time);
+    }
+    loser_adjust(tree, merge, k, w);
+
+    if (fill == MERGE_BLOCK) {
+      if (writing) {
+        finish_transfer(&writer, &write_time);
+      }
+      checksum_add(output, blocks[block], fill);
+      start_transfer(&writer, out, blocks[block], fill,
+                     (off_t)(written * sizeof(int)), true);
+      writing = true;
+      written += fill;
+      block ^= 1;
+      fill = 0;
+    }
+  }
+  if (writing) {
+    finish_transfer(&writer, &write_time);
+  }
+  checksum_add(output, blocks[block], fill);
+  if (write_at(out, blocks[block], fill * sizeof(int),
+               (off_t)(written * sizeof(int))) != 0) {
+    perror("write");
+    exit(EXIT_FAILURE);
+  }
+  written += fill;
+
+  double bytes = (double)total * sizeof(int);
+  double elapsed = now_seconds() - start;
+  fprintf(stderr,
+          "merge: %d-way, %.2f GB in %.3fs: %.3f GB/s "
+          "(read %.3f, write %.3f GB/s)\n",
+          k, bytes / 1e9, elapsed, gb_per_sec(bytes, elapsed),
+          gb_per_sec(bytes, read_time), gb_per_sec(bytes, write_time));
+  assert(written == total);
+
+  for (int r = 0; r < k; r++) {
+    free(merge[r].buf);
+  }
+  free(merge);
+  free(tree);
+  free(blocks[0]);
+  free(blocks[1]);
+}
+
+/* Reads `out` back in order, exiting unless it is sorted. */
+void check_sorted(int out, size_t total) {
+  size_t block = MERGE_BLOCK;
+  int *buf = malloc(block * sizeof(int));
+  double start = now_seconds();
+  int last = INT_MIN;
+  for (size_t at = 0; at < total; at += block) {
+    size_t len = total - at < block ? total - at : block;
+    if (read_at(out, buf, len * sizeof(int), (off_t)(at * sizeof(int))) !=
+        (ssize_t)(len * sizeof(int))) {
+      perror("read");
+      exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < len; i++) {
+      if (buf[i] < last) {
+        fprintf(stderr, "error after sorting: out[%zu] < out[%zu]\n",
+                at + i, at + i - 1);
+        exit(EXIT_FAILURE);
+      }
+      last = buf[i];
+    }
+  }
+  double bytes = (double)total * sizeof(int);
+  double elapsed = now_seconds() - start;
+  fprintf(stderr, "check: sorted, %.3f GB/s\n", gb_per_sec(bytes, elapsed));
+  free(buf);
+}
+
+/*
+ * Sorts the ints of file `input` into file `output` using at most about
+ * 3 * run_mb MB of memory. Runs are kept in `output`.runs meanwhile,
+ * and neither file may be the input.
+ */
+int external_sort(const char *input, const char *output, size_t run_mb,
+                  QuickSorter config) {
+  int in = open(input, O_RDONLY);
+  if (in < 0) {
+    perror(input);
+    return EXIT_FAILURE;
+  }
+  struct stat in_stat;
+  off_t size = lseek(in, 0, SEEK_END);
+  if (fstat(in, &in_stat) != 0 || size < 0 ||
+      size % (off_t)sizeof(int) != 0) {
+    fprintf(stderr, "%s does not hold whole ints\n", input);
+    return EXIT_FAILURE;
+  }
+  size_t total = (size_t)size / sizeof(int);
+  size_t run_len = run_mb * 1000000 / sizeof(int);
+  if (run_len > INT_MAX) {
+    run_len = INT_MAX; /* QuickSort takes int lengths */
+  }
+  if (run_len < MERGE_MIN_BUFFER) {
+    run_len = MERGE_MIN_BUFFER;
+  }
+  size_t runs = (total + run_len - 1) / run_len;
+
+  /*
+   * Neither file is truncated before it is known not to be the input.
+   * The runs file is unlinked as soon as it is open, so it disappears
+   * however the sort ends.
+   */
+  char *tmp_name = malloc(strlen(output) + sizeof(".runs"));
+  sprintf(tmp_name, "%s.runs", output);
+  const char *names[2] = {tmp_name, output};
+  int fds[2];
+  for (int f = 0; f < 2; f++) {
+    struct stat st;
+    fds[f] = open(names[f], O_RDWR | O_CREAT, f == 0 ? 0600 : 0644);
+    if (fds[f] < 0 || fstat(fds[f], &st) != 0) {
+      perror(names[f]);
+      return EXIT_FAILURE;
+    }
+    if (st.st_dev == in_stat.st_dev && st.st_ino == in_stat.st_ino) {
+      fprintf(stderr, "%s is the input %s, not overwriting it\n",
+              names[f], input);
+      if (f == 0) {
+        close(fds[f]);
+      }
+      return EXIT_FAILURE;
+    }
+    if (f == 0 && unlink(tmp_name) != 0) {
+      perror(tmp_name);
+      return EXIT_FAILURE;
+    }
+    if (ftruncate(fds[f], 0) != 0) {
+      perror(names[f]);
+      return EXIT_FAILURE;
+    }
+  }
+  int tmp = fds[0];
+  int out = fds[1];
+
+  fprintf(stderr,
+          "sorting %zu ints (%.2f GB) in runs of %zu with %s, %s, %s\n",
+          total, (double)size / 1e9, run_len, config.pivot.name,
+          config.partition.name, config.callback.name);
+  double start = now_seconds();
+  Checksum before = {0, 0};
+  Checksum after = {0, 0};
+  if (runs > 0) {
+    form_runs(in, tmp, total, run_len, runs, config, &before);
+    merge_runs(tmp, out, total, run_len, runs, &after);
+  }
+  double elapsed = now_seconds() - start;
+  fprintf(stderr, "total: %.3fs, %.3f GB/s\n", elapsed,
+          gb_per_sec((double)size, elapsed));
+
+  close(tmp);
+  free(tmp_name);
+  close(in);
+
+  check_sorted(out, total);
+  close(out);
+  if (before.sum != after.sum || before.squares != after.squares) {
+    fprintf(stderr, "error after sorting: output is not a permutation\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+/* Writes `count` random ints to `path` for external sorting. */
+int generate_file(const char *path, size_t count) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  int *buf = malloc(MERGE_BLOCK * sizeof(int));
+  if (fd < 0 || buf == NULL) {
+    perror(path);
+    return EXIT_FAILURE;
+  }
+  uint64_t x = DEFAULT_SEED; /* xorshift64, rand() is too slow here */
+  for (size_t at = 0; at < count; at += MERGE_BLOCK) {
+    size_t len = count - at < MERGE_BLOCK ? count - at : MERGE_BLOCK;
+    for (size_t i = 0; i < len; i++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      buf[i] = (int)(uint32_t)x;
+    }
+    if (write_at(fd, buf, len * sizeof(int), (off_t)(at * sizeof(int))) !=
+        0) {
+      perror(path);
+      return EXIT_FAILURE;
+    }
+  }
+  free(buf);
+  close(fd);
+  return EXIT_SUCCESS;
+}
+
+/* === Sample sort === */
+
+/*
+ * Sorts in parallel without a serial top level partition. Splitters come
+ * from a sorted sample, one per bucket, each picked by the configured
+ * pivot function from a group of samples around its quantile. Each
+ * thread then classifies its slice of the array and counts its elements
+ * per bucket. Each bucket is allocated and first touched by the thread
+ * that will sort it, so its pages live on that thread's NUMA node. After
+ * the threads scatter their slices into the buckets, every thread sorts
+ * its own bucket with QuickSort and copies it back into place.
+ */
+
+/* Samples per bucket */
+#define SAMPLE_OVERSAMPLING 64
+
+/* Buckets are numbered with a byte, one per thread */
+#define SAMPLE_MAX_THREADS 256
+
+/* Arrays below this many ints per thread are sorted by QuickSort alone */
+#define SAMPLE_MIN_PER_THREAD (1 << 14)
+
+int sample_threads = 1;
+
+typedef struct sample_sort_ {
+  int *arr;
+  size_t len;
+  int threads;
+  QuickSorter config;
+  unsigned int seed;   /* mixed with each thread's id for its pivots */
+  int *splitters;      /* threads - 1 splitters, ascending */
+  uint8_t *buckets;    /* bucket of every element */
+  size_t *counts;      /* per thread, per bucket counts, then offsets */
+  int **bucket;        /* the elements of each bucket */
+  size_t *bucket_len;
+  pthread_barrier_t barrier;
+} SampleSort;
+
+typedef struct sample_worker_ {
+  SampleSort *sort;
+  int id;
+  pthread_t thread;
+} SampleWorker;
+
+/* Number of splitters at most `x`, a branch free binary search. */
+int bucket_of(const int splitters[], int count, int x) {
+  int b = 0;
+  while (count > 0) {
+    int half = count / 2;
+    bool right = splitters[b + half] <= x;
+    b = right ? b + half + 1 : b;
+    count = right ? count - half - 1 : half;
+  }
+  return b;
+}
+
+void *sample_worker(void *arg) {
+  SampleWorker *worker = arg;
+  SampleSort *s = worker->sort;
+  int id = worker->id;
+  int threads = s->threads;
+  size_t lo = s->len * id / threads;
+  size_t hi = s->len * (id + 1) / threads;
+  size_t *counts = s->counts + (size_t)id * threads;
+
+#ifdef __linux__
+  cpu_set_t cpu;
+  CPU_ZERO(&cpu);
+  CPU_SET(id, &cpu);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu), &cpu);
+#endif
+
+  for (size_t i = lo; i < hi; i++) {
+    int b = bucket_of(s->splitters, threads - 1, s->arr[i]);
+    s->buckets[i] = (uint8_t)b;
+    counts[b]++;
+  }
+  pthread_barrier_wait(&s->barrier);
+
+  /* turn this bucket's column of counts into each thread's offset */
+  size_t total = 0;
+  for (int t = 0; t < threads; t++) {
+    size_t count = s->counts[(size_t)t * threads + id];
+    s->counts[(size_t)t * threads + id] = total;
+    total += count;
+  }
+  s->bucket_len[id] = total;
+  s->bucket[id] = malloc((total > 0 ? total : 1) * sizeof(int));
+  if (s->bucket[id] == NULL) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  memset(s->bucket[id], 0, total * sizeof(int));
+  pthread_barrier_wait(&s->barrier);
+
+  for (size_t i = lo; i < hi; i++) {
+    int b = s->buckets[i];
+    s->bucket[b][counts[b]++] = s->arr[i];
+  }
+  pthread_barrier_wait(&s->barrier);
+
+  size_t start = 0;
+  for (int b = 0; b < id; b++) {
+    start += s->bucket_len[b];
+  }
+  /* pivots come from this thread's own state, never a shared one */
+  unsigned int seed = s->seed ^ (unsigned int)id * 2654435761U;
+  QuickSorter config = s->config;
+  config.seed = &seed;
+  QuickSort(s->bucket[id], (int)total, config, true);
+  memcpy(s->arr + start, s->bucket[id], total * sizeof(int));
+  free(s->bucket[id]);
+  return NULL;
+}
+
+/* Picks `threads - 1` splitters for `arr` with the configured pivot. */
+void pick_splitters(SampleSort *s) {
+  int samples = s->threads * SAMPLE_OVERSAMPLING;
+  int *sample = malloc(samples * sizeof(int));
+  if (sample == NULL) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < samples; i++) {
+    sample[i] = s->arr[s->len * i / samples];
+  }
+  QuickSort(sample, samples, s->config, true);
+  /* groups do not overlap, so the splitters stay in ascending order */
+  for (int b = 1; b < s->threads; b++) {
+    int *group = sample + b * SAMPLE_OVERSAMPLING - SAMPLE_OVERSAMPLING / 2;
+    s->splitters[b - 1] =
+        s->config.pivot.func(group, SAMPLE_OVERSAMPLING, s->config.seed);
+  }
+  free(sample);
+}
+
+void SampleSortArray(int arr[], int len, QuickSorter config) {
+  int threads = sample_threads;
+  if (threads > SAMPLE_MAX_THREADS) {
+    threads = SAMPLE_MAX_THREADS;
+  }
+  if (threads < 2 || len / threads < SAMPLE_MIN_PER_THREAD) {
+    QuickSort(arr, len, config, true);
+    return;
+  }
+
+  SampleSort s = {.arr = arr, .len = len, .threads = threads, .config = config};
+  s.splitters = malloc((threads - 1) * sizeof(int));
+  s.buckets = malloc(len);
+  s.counts = calloc((size_t)threads * threads, sizeof(size_t));
+  s.bucket = malloc(threads * sizeof(int *));
+  s.bucket_len = malloc(threads * sizeof(size_t));
+  SampleWorker *workers = malloc(threads * sizeof(SampleWorker));
+  if (s.splitters == NULL || s.buckets == NULL || s.counts == NULL ||
+      s.bucket == NULL || s.bucket_len == NULL || workers == NULL) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  s.seed = (unsigned int)rand_r(config.seed);
+  pick_splitters(&s);
+
+  pthread_barrier_init(&s.barrier, NULL, threads);
+  for (int t = 0; t < threads; t++) {
+    workers[t] = (SampleWorker){.sort = &s, .id = t};
+    pthread_create(&workers[t].thread, NULL, sample_worker, &workers[t]);
+  }
+  for (int t = 0; t < threads; t++) {
+    pthread_join(workers[t].thread, NULL);
+  }
+  pthread_barrier_destroy(&s.barrier);
+
+  free(workers);
+  free(s.bucket_len);
+  free(s.bucket);
+  free(s.counts);
+  free(s.buckets);
+  free(s.splitters);
+}
+
+/* === Sorters === */
+
+typedef void (*sort_func)(int[], int, QuickSorter);
+typedef struct sort_engine_ {
+  sort_func func;
+  char *name;
+} Sorter;
+
+void QuickSortArray(int arr[], int len, QuickSorter config) {
+  QuickSort(arr, len, config, true);
+}
+
+Sorter sorters[2] = {{QuickSortArray, "QuickSort"},
+                     {SampleSortArray, "Sample Sort"}};
+
+/*
+ * Hoare partitioning leaves arrays unsorted, and with Median of 3 it
+ * overflows the stack on a few million ints, so the benchmark skips it.
+ */
+bool benchmarked(Partition partition) { return partition.func != hoare; }
+
 /* === MAIN === */
 
 int main(int argc, char *argv[]) {
   int range;
   int thresholdMax;
-  clock_t start;
-  clock_t finish;
+  double start;
+  double finish;
+
+  if (argc >= 4 && strcmp(argv[1], "--external") == 0) {
+    size_t run_mb = argc >= 5 ? parse_int(argv[4]) : 256;
+    unsigned int pivot = argc >= 8 ? parse_int(argv[5]) : 0;
+    unsigned int part = argc >= 8 ? parse_int(argv[6]) : 1;
+    unsigned int call = argc >= 8 ? parse_int(argv[7]) : 1;
+    if (run_mb == 0 || pivot >= sizeof(pivots) / sizeof(*pivots) ||
+        part >= sizeof(partitions) / sizeof(*partitions) ||
+        call >= sizeof(callbacks) / sizeof(*callbacks)) {
+      fprintf(stderr, "usage: %s --external <input> <output> [run_mb "
+                      "[pivot partition callback]]\n",
+              argv[0]);
+      exit(EXIT_FAILURE);
+    }
+    QuickSorter config = {pivots[pivot], partitions[part], callbacks[call],
+                          &pivot_seed};
+    return external_sort(argv[2], argv[3], run_mb, config);
+  }
+  if (argc == 4 && strcmp(argv[1], "--generate") == 0) {
+    char *end;
+    unsigned long long count = strtoull(argv[3], &end, INT_RADIX_BASE);
+    if (*end != '\0') {
+      fprintf(stderr, "%s is not a count\n", argv[3]);
+      exit(EXIT_FAILURE);
+    }
+    return generate_file(argv[2], (size_t)count);
+  }
 
   // srand(DEFAULT_SEED); // reproducible seed
   srand(time(NULL)); // closer to random.
+  pivot_seed = (unsigned int)time(NULL);
+
+  sample_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (argc >= 4) {
+    sample_threads = parse_int(argv[3]);
+  }
 
-  if (argc == 3) {
+  if (argc >= 3) {
     thresholdMax = parse_int(argv[2]);
     range = parse_int(argv[1]);
   } else if (argc == 2) {
@@ -195,51 +950,77 @@ int main(int argc, char *argv[]) {
     range = DEFAULT_RANGE;
   }
 
-  printf("pivot,partition,callback,size,time\n");
+  fprintf(stderr, "Sample sorting with %d threads\n", sample_threads);
+  printf("pivot,partition,callback,size,time,sorter\n");
 
   int windows = 100;
   int repeats = 100;
   int pivot_count = sizeof(pivots) / sizeof(*pivots);
   int partition_count = sizeof(partitions) / sizeof(*partitions);
+  int benchmarked_count = 0;
+  for (int part = 0; part < partition_count; part++) {
+    if (benchmarked(partitions[part])) {
+      benchmarked_count++;
+    } else {
+      fprintf(stderr, "Skipping the %s partition\n", partitions[part].name);
+    }
+  }
   int callback_count = sizeof(callbacks) / sizeof(*callbacks);
+  int sorter_count = sizeof(sorters) / sizeof(*sorters);
 
   int trial = 1;
-  int trials =
-      windows * repeats * pivot_count * partition_count * callback_count;
+  int trials = windows * repeats * pivot_count * benchmarked_count *
+               callback_count * sorter_count;
 
   for (int size = range; size <= windows * range; size += range) {
     int *arr = init_array(size);
     fprintf(stderr, "\n");
     for (int pivot = 0; pivot < pivot_count; pivot++) {
       for (int part = 0; part < partition_count; part++) {
+        if (!benchmarked(partitions[part])) {
+          continue;
+        }
         for (int call = 0; call < callback_count; call++) {
-          QuickSorter config = {pivots[pivot], partitions[part],
-                                callbacks[call]};
-          double time = 0;
-          for (int n = 1; n <= repeats; n++) {
-            fprintf(stderr, "\rTrial # %d / %d done. (%0.2f%% of all values) ",
-                    trial, trials, 100.0 * pow((double)trial / trials, 2.0));
-
-            int *tmp = (int *)malloc(size * sizeof(int));
-            memcpy(tmp, arr, size * sizeof(int));
-            start = clock();
-            QuickSort(tmp, size, config, true);
-            finish = clock();
-
-            for (int idx = 0; idx < size - 1; idx++) {
-              if (tmp[idx] > tmp[idx + 1]) {
-                fprintf(stderr,
-                        "error after sorting: tmp[%d] > tmp[%d], (%d > %d)\n.",
-                        idx, idx + 1, tmp[idx], tmp[idx + 1]);
-                exit(EXIT_FAILURE);
+          for (int sorter = 0; sorter < sorter_count; sorter++) {
+            QuickSorter config = {pivots[pivot], partitions[part],
+                                  callbacks[call], &pivot_seed};
+            double time = 0;
+            bool sorted = true;
+            for (int n = 1; n <= repeats && sorted; n++) {
+              fprintf(stderr,
+                      "\rTrial # %d / %d done. (%0.2f%% of all values) ",
+                      trial, trials,
+                      100.0 * pow((double)trial / trials, 2.0));
+
+              int *tmp = (int *)malloc(size * sizeof(int));
+              memcpy(tmp, arr, size * sizeof(int));
+              /* wall clock, as clock() adds up the CPU time of threads */
+              start = now_seconds();
+              sorters[sorter].func(tmp, size, config);
+              finish = now_seconds();
+
+              for (int idx = 0; idx < size - 1 && sorted; idx++) {
+                if (tmp[idx] > tmp[idx + 1]) {
+                  /* log the config and carry on with the next one */
+                  fprintf(stderr,
+                          "\nerror after sorting with %s, %s, %s, %s: "
+                          "tmp[%d] > tmp[%d], (%d > %d)\n",
+                          pivots[pivot].name, partitions[part].name,
+                          callbacks[call].name, sorters[sorter].name, idx,
+                          idx + 1, tmp[idx], tmp[idx + 1]);
+                  sorted = false;
+                }
               }
+              time += (finish - start) / repeats;
+              trial++;
+              free(tmp);
+            }
+            if (sorted) {
+              printf("%s,%s,%s,%d,%f,%s\n", pivots[pivot].name,
+                     partitions[part].name, callbacks[call].name, size,
+                     time, sorters[sorter].name);
             }
-            time += (double)(finish - start) / (repeats * CLOCKS_PER_SEC);
-            trial++;
-            free(tmp);
           }
-          printf("%s,%s,%s,%d,%f\n", pivots[pivot].name, partitions[part].name,
-                 callbacks[call].name, size, time);
         }
       }
     }
@@ -0,0 +1,478 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr int INT_RADIX_BASE = 10;
+
+// Longest word kept, in bytes. Node depths are stored in one byte.
+constexpr size_t MAX_WORD = 255;
+
+// First bytes of an index file written by `--build`
+constexpr char MAGIC[8] = {'T', 'R', 'I', 'E', 'I', 'D', 'X', '1'};
+
+/*
+=========================================================================
+Compact preorder trie
+=========================================================================
+*/
+
+/**
+ * @brief one trie node, stored in preorder
+ * @note the node's subtree is the index range [this, end), so its first
+ * child is the next node and each child's `end` is its next sibling.
+ * Preorder of a trie over sorted words visits words in sorted order, so
+ * the words under a prefix are a contiguous scan of that range
+ */
+struct trie_node {
+  uint32_t end;   // one past the last node of the subtree
+  uint8_t label;  // byte on the edge into this node
+  uint8_t depth;  // length of the word spelled down to this node
+  uint8_t word;   // 1 if a word ends here
+  uint8_t unused; // keeps the layout at 8 bytes with no padding
+};
+
+static_assert(sizeof(trie_node) == 8, "index files assume 8 byte nodes");
+
+/** @brief header of an index file, followed by `nodes` `trie_node`s */
+struct index_header {
+  char magic[8];
+  uint64_t nodes;
+  uint64_t words;
+};
+
+/**
+ * @brief read-only prefix search over a preorder trie, either built in
+ * memory or mapped from an index file
+ */
+class compact_trie {
+  vector<trie_node> owned_{};
+  const trie_node *nodes_ = nullptr;
+  size_t size_ = 0;
+  size_t words_ = 0;
+  void *map_ = nullptr;
+  size_t map_len_ = 0;
+
+  /** @returns the node spelling `prefix`, or 0 with `found` false */
+  size_t descend(string_view prefix, bool &found) const {
+    size_t node = 0;
+    found = size_ > 0;
+    for (char ch : prefix) {
+      auto label = static_cast<uint8_t>(ch);
+      size_t child = node + 1;
+      // children are in label order, each after its elder's subtree
+      while (child < nodes_[node].end && nodes_[child].label < label) {
+        child = nodes_[child].end;
+      }
+      if (child >= nodes_[node].end || nodes_[child].label != label) {
+        found = false;
+        return 0;
+      }
+      node = child;
+    }
+    return node;
+  }
+
+public:
+  compact_trie() = default;
+
+  /**
+   * @brief builds the trie of `words`
+   * @note sorts and deduplicates `words`. Empty words and words longer
+   * than `MAX_WORD` bytes are dropped
+   */
+  explicit compact_trie(vector<string> words) {
+    sort(words.begin(), words.end());
+    words.erase(unique(words.begin(), words.end()), words.end());
+
+    owned_.push_back({0, 0, 0, 0, 0});
+    vector<uint32_t> path{0}; // open nodes, by depth
+    string_view previous{};
+    for (const string &word : words) {
+      if (word.empty() || word.size() > MAX_WORD) {
+        continue;
+      }
+      size_t common = 0;
+      while (common < previous.size() && common < word.size() &&
+             previous[common] == word[common]) {
+        common++;
+      }
+      // subtrees deeper than the shared prefix are complete
+      while (path.size() > common + 1) {
+        owned_[path.back()].end = static_cast<uint32_t>(owned_.size());
+        path.pop_back();
+      }
+      for (size_t d = common; d < word.size(); d++) {
+        path.push_back(static_cast<uint32_t>(owned_.size()));
+        owned_.push_back({0, static_cast<uint8_t>(word[d]),
+                          static_cast<uint8_t>(d + 1), 0, 0});
+      }
+      owned_[path.back()].word = 1;
+      words_++;
+      previous = word;
+    }
+    for (uint32_t node : path) {
+      owned_[node].end = static_cast<uint32_t>(owned_.size());
+    }
+    owned_.shrink_to_fit();
+    nodes_ = owned_.data();
+    size_ = owned_.size();
+  }
+
+  /**
+   * @brief maps a prebuilt index file
+   * @note the nodes are used in place, so loading does not touch them
+   */
+  static compact_trie load(const string &path) {
+    compact_trie trie{};
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st {};
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      perror(path.c_str());
+      exit(EXIT_FAILURE);
+    }
+    trie.map_len_ = static_cast<size_t>(st.st_size);
+    if (trie.map_len_ < sizeof(index_header)) {
+      cerr << path << ": not a trie index" << endl;
+      exit(EXIT_FAILURE);
+    }
+    trie.map_ =
+        mmap(nullptr, trie.map_len_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (trie.map_ == MAP_FAILED) {
+      perror(path.c_str());
+      exit(EXIT_FAILURE);
+    }
+
+    index_header header{};
+    memcpy(&header, trie.map_, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.nodes == 0 ||
+        sizeof(header) + header.nodes * sizeof(trie_node) !=
+            trie.map_len_) {
+      cerr << path << ": not a trie index" << endl;
+      exit(EXIT_FAILURE);
+    }
+    trie.nodes_ = reinterpret_cast<const trie_node *>(
+        static_cast<const char *>(trie.map_) + sizeof(header));
+    trie.size_ = header.nodes;
+    trie.words_ = header.words;
+    return trie;
+  }
+
+  compact_trie(compact_trie &&other) noexcept { *this = move(other); }
+
+  compact_trie &operator=(compact_trie &&other) noexcept {
+    swap(owned_, other.owned_);
+    swap(nodes_, other.nodes_);
+    swap(size_, other.size_);
+    swap(words_, other.words_);
+    swap(map_, other.map_);
+    swap(map_len_, other.map_len_);
+    return *this;
+  }
+
+  compact_trie(const compact_trie &) = delete;
+  compact_trie &operator=(const compact_trie &) = delete;
+
+  ~compact_trie() {
+    if (map_ != nullptr) {
+      munmap(map_, map_len_);
+    }
+  }
+
+  /** @brief writes the index file `load` maps */
+  bool save(const string &path) const {
+    index_header header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.nodes = size_;
+    header.words = words_;
+    ofstream out(path, ios::binary);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(nodes_),
+              static_cast<streamsize>(size_ * sizeof(trie_node)));
+    return static_cast<bool>(out);
+  }
+
+  size_t nodes() const { return size_; }
+  size_t words() const { return words_; }
+  size_t bytes() const { return size_ * sizeof(trie_node); }
+
+  /**
+   * @brief passes the first `size` words starting with `prefix`, in
+   * sorted order, to `emit` as `string_view`s
+   * @note the views share one stack buffer and are only valid during the
+   * call. Nothing is allocated
+   * @returns the number of words emitted
+   */
+  template <typename Emit>
+  size_t find_with_prefix(string_view prefix, size_t size,
+                          Emit &&emit) const {
+    bool found = false;
+    size_t node = descend(prefix, found);
+    if (!found || size == 0) {
+      return 0;
+    }
+
+    char word[MAX_WORD];
+    memcpy(word, prefix.data(), prefix.size());
+    size_t count = 0;
+    for (size_t at = node; at < nodes_[node].end; at++) {
+      const trie_node &n = nodes_[at];
+      if (at != node) {
+        word[n.depth - 1] = static_cast<char>(n.label);
+      }
+      if (n.word) {
+        emit(string_view(word, n.depth));
+        if (++count == size) {
+          break;
+        }
+      }
+    }
+    return count;
+  }
+
+  /** @brief the trie.js `findWithPrefix` contract */
+  vector<string> find_with_prefix(string_view prefix, size_t size) const {
+    vector<string> words{};
+    find_with_prefix(prefix, size, [&](string_view word) {
+      words.emplace_back(word);
+    });
+    return words;
+  }
+};
+
+/*
+=========================================================================
+Baseline: the trie.js structure
+=========================================================================
+*/
+
+/**
+ * @brief one object per character with a map of children, searched by
+ * concatenating the arrays of every subtree, as in trie.js
+ */
+struct map_trie {
+  bool is_word = false;
+  map<char, unique_ptr<map_trie>> children{};
+
+  explicit map_trie(const vector<string> &words = {}) {
+    for (const string &word : words) {
+      map_trie *curr = this;
+      for (char c : word) {
+        auto &sub = curr->children[c];
+        if (!sub) {
+          sub = make_unique<map_trie>();
+        }
+        curr = sub.get();
+      }
+      if (!word.empty()) {
+        curr->is_word = true;
+      }
+    }
+  }
+
+  vector<string> find_with_prefix(const string &prefix, long size) const {
+    const map_trie *curr = this;
+    for (char c : prefix) {
+      auto found = curr->children.find(c);
+      if (found == curr->children.end()) {
+        return {};
+      }
+      curr = found->second.get();
+    }
+
+    vector<string> words{};
+    long count = 0;
+    if (curr->is_word) {
+      words.push_back(prefix);
+      count++;
+    }
+    for (const auto &[c, child] : curr->children) {
+      for (const string &suffix : child->find_with_prefix("", size - count)) {
+        if (count < size) {
+          words.push_back(prefix + c + suffix);
+          count++;
+        }
+      }
+    }
+    words.resize(min<size_t>(words.size(), max(0L, size)));
+    return words;
+  }
+};
+
+/*
+=========================================================================
+Driver
+=========================================================================
+*/
+
+/** @brief one word per line, as in the trie.html dictionaries */
+vector<string> read_words(const string &path) {
+  ifstream in(path);
+  if (!in) {
+    perror(path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  vector<string> words{};
+  string line;
+  while (getline(in, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (!line.empty()) {
+      words.push_back(line);
+    }
+  }
+  return words;
+}
+
+/** @returns whether `path` starts with the index file magic */
+bool is_index(const string &path) {
+  char magic[sizeof(MAGIC)] = {};
+  ifstream in(path, ios::binary);
+  in.read(magic, sizeof(magic));
+  return in && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+compact_trie open_trie(const string &path) {
+  return is_index(path) ? compact_trie::load(path)
+                        : compact_trie(read_words(path));
+}
+
+/** @brief writes `n` random lowercase words, one per line */
+void generate(long n) {
+  // rough english letter frequencies, in percent
+  const double weights[26] = {8.2, 1.5, 2.8, 4.3, 12.7, 2.2, 2.0, 6.1, 7.0,
+                              0.2, 0.8, 4.0, 2.4, 6.7,  7.5, 1.9, 0.1, 6.0,
+                              6.3, 9.1, 2.8, 1.0, 2.4,  0.2, 2.0, 0.1};
+  mt19937_64 rng(n);
+  discrete_distribution<int> letter(begin(weights), end(weights));
+  binomial_distribution<int> length(16, 0.5);
+  string word;
+  for (long i = 0; i < n; i++) {
+    word.clear();
+    int len = max(2, length(rng));
+    for (int c = 0; c < len; c++) {
+      word.push_back(static_cast<char>('a' + letter(rng)));
+    }
+    cout << word << "\n";
+  }
+}
+
+double seconds_since(steady_clock::time_point start) {
+  return duration<double>(steady_clock::now() - start).count();
+}
+
+/**
+ * @brief times top-10 prefix queries of 1 to 4 letter prefixes of the
+ * dictionary's own words, against the trie.js structure
+ */
+void bench(const string &path, long queries) {
+  auto start = steady_clock::now();
+  bool index = is_index(path);
+  compact_trie trie = open_trie(path);
+  cout << (index ? "mapped " : "built ") << trie.words() << " words, "
+       << trie.nodes() << " nodes, " << trie.bytes() / 1e6 << " MB in "
+       << seconds_since(start) << "s" << endl;
+
+  // prefixes are sampled from the trie itself, so an index needs no
+  // word list
+  vector<string> prefixes{};
+  mt19937_64 rng(queries);
+  vector<string> sample = trie.find_with_prefix("", 1 << 16);
+  if (sample.empty()) {
+    cerr << path << ": no words" << endl;
+    exit(EXIT_FAILURE);
+  }
+  uniform_int_distribution<size_t> pick(0, sample.size() - 1);
+  uniform_int_distribution<size_t> cut(1, 4);
+  for (long q = 0; q < queries; q++) {
+    const string &word = sample[pick(rng)];
+    prefixes.push_back(word.substr(0, min(word.size(), cut(rng))));
+  }
+
+  size_t total = 0;
+  start = steady_clock::now();
+  for (const string &prefix : prefixes) {
+    total += trie.find_with_prefix(prefix, 10, [&](string_view word) {
+      total += word.size();
+    });
+  }
+  double compact = seconds_since(start);
+
+  start = steady_clock::now();
+  for (const string &prefix : prefixes) {
+    total += trie.find_with_prefix(prefix, 10).size();
+  }
+  double copied = seconds_since(start);
+
+  cout << "compact trie:        " << compact / queries * 1e9
+       << " ns/query" << endl;
+  cout << "  returning strings: " << copied / queries * 1e9
+       << " ns/query" << endl;
+
+  if (!index) {
+    // it copies every word under the prefix, so time fewer queries
+    long slow = min(queries, 1000L);
+    start = steady_clock::now();
+    map_trie baseline(read_words(path));
+    double build = seconds_since(start);
+    start = steady_clock::now();
+    for (long q = 0; q < slow; q++) {
+      total += baseline.find_with_prefix(prefixes[q], 10).size();
+    }
+    cout << "trie.js structure:   " << seconds_since(start) / slow * 1e9
+         << " ns/query, built in " << build << "s" << endl;
+  }
+  if (total == 0) {
+    cout << "no matches" << endl;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc >= 4 && strcmp(argv[1], "--build") == 0) {
+    compact_trie trie(read_words(argv[2]));
+    if (!trie.save(argv[3])) {
+      perror(argv[3]);
+      exit(EXIT_FAILURE);
+    }
+    cout << trie.words() << " words, " << trie.nodes() << " nodes written to "
+         << argv[3] << endl;
+  } else if (argc >= 3 && strcmp(argv[1], "--bench") == 0) {
+    long queries =
+        argc >= 4 ? strtol(argv[3], nullptr, INT_RADIX_BASE) : 1000000;
+    bench(argv[2], max(1L, queries));
+  } else if (argc >= 3 && strcmp(argv[1], "--generate") == 0) {
+    generate(strtol(argv[2], nullptr, INT_RADIX_BASE));
+  } else if (argc >= 3 && argv[1][0] != '-') {
+    long size = argc >= 4 ? strtol(argv[3], nullptr, INT_RADIX_BASE) : 10;
+    compact_trie trie = open_trie(argv[1]);
+    trie.find_with_prefix(argv[2], static_cast<size_t>(max(0L, size)),
+                          [](string_view word) { cout << word << "\n"; });
+  } else {
+    cerr << "Usage: " << argv[0] << " <words|index> <prefix> [size]" << endl;
+    cerr << "       " << argv[0] << " --build <words> <index>" << endl;
+    cerr << "       " << argv[0] << " --bench <words|index> [queries]"
+         << endl;
+    cerr << "       " << argv[0] << " --generate <n>" << endl;
+    exit(EXIT_FAILURE);
+  }
+}
@@ -1,5 +1,10 @@
+#include <array>
 #include <chrono>
+#include <cstring>
 #include <iostream>
+#include <utility>
+
+#include "prime_stream.hh"
 
 using namespace std::chrono;
 constexpr int INT_RADIX_BASE = 10;
@@ -59,8 +64,9 @@ inline bool is_prime(uint64_t n) {
                         450775, 9780504, 1795265022};
 
   for (int w = 0; w < 7; w++) {
-    uint64_t a = witnesses[w];
-    if (a == n) {
+    // a witness that is a multiple of n says nothing about it
+    uint64_t a = witnesses[w] % n;
+    if (a == 0) {
       continue;
     }
 
@@ -83,63 +89,209 @@ inline bool is_prime(uint64_t n) {
   return true;
 }
 
-uint64_t prod(const uint64_t bases[], uint64_t count) {
-  size_t result = 1;
-  while (count) {
-    count--;
-    result *= bases[count];
-  }
-  return result;
-}
+// the primes the wheels are built from, 2 through 17
+constexpr uint64_t WHEEL_BASES[]{2, 3, 5, 7, 11, 13, 17};
+constexpr size_t MAX_WHEEL =
+    sizeof(WHEEL_BASES) / sizeof(WHEEL_BASES[0]);
 
-uint64_t build_pegs(uint64_t pegs[], const uint64_t pegs_size,
-                    const uint64_t bases[], const uint64_t bases_count) {
-  uint64_t index = 0;
-  for (uint64_t n = 2; n < pegs_size; n++) {
-    uint64_t b = 0;
-    for (; b < bases_count; b++) {
-      if (n % bases[b] == 0) {
-        break;
+// Wheels through the 2 to 13 one (5760 spokes) are rolled at compile
+// time. Rolling the 2 to 17 wheel takes ~100k loop iterations, which
+// runs past the default constexpr step limits of clang, so larger
+// wheels are rolled once at startup instead.
+constexpr size_t CONSTANT_WHEELS = 6;
+
+/**
+ * @brief the numbers coprime to the first K primes, as gaps between them
+ * @tparam K how many of `WHEEL_BASES` the wheel skips multiples of
+ * @note starting at 1, adding `gaps` in turn visits every number coprime
+ * to the bases. Each table is built by rolling the wheel one size down
+ * `WHEEL_BASES[K - 1]` times and dropping the multiples of that base.
+ */
+template <size_t K, bool Constant = K <= CONSTANT_WHEELS> struct Wheel;
+
+/** @brief the size and table building shared by both kinds of `Wheel` */
+template <size_t K> struct WheelShape {
+  static_assert(K <= MAX_WHEEL, "no base prime for this wheel");
+  static constexpr uint64_t base = WHEEL_BASES[K - 1];
+  // circumference, the product of the bases
+  static constexpr uint64_t size = base * Wheel<K - 1>::size;
+  // numbers coprime to the bases per turn of the wheel
+  static constexpr size_t spokes = (base - 1) * Wheel<K - 1>::spokes;
+
+  static constexpr std::array<uint8_t, spokes> roll() {
+    std::array<uint8_t, spokes> gaps{};
+    uint64_t n = 1;
+    uint64_t last = 1;
+    size_t spoke = 0;
+    for (uint64_t turn = 0; turn < base; turn++) {
+      for (uint8_t gap : Wheel<K - 1>::gaps) {
+        n += gap;
+        if (n % base != 0) {
+          gaps[spoke++] = static_cast<uint8_t>(n - last);
+          last = n;
+        }
       }
     }
-    if (b == bases_count) {
-      pegs[index++] = n;
-    }
+    return gaps;
   }
-  return index;
-}
+};
 
-int main(int argc, char *argv[]) {
-  uint64_t count = 1000;
-  if (argc > 1) {
-    count = strtol(argv[1], NULL, INT_RADIX_BASE);
+/** @brief a wheel whose table is rolled at compile time */
+template <size_t K> struct Wheel<K, true> : WheelShape<K> {
+  static constexpr std::array<uint8_t, WheelShape<K>::spokes> gaps =
+      WheelShape<K>::roll();
+};
+
+/** @brief a wheel whose table is rolled at startup */
+template <size_t K> struct Wheel<K, false> : WheelShape<K> {
+  static const std::array<uint8_t, WheelShape<K>::spokes> gaps;
+
+  // not constexpr, so the compiler never tries to roll it
+  static std::array<uint8_t, WheelShape<K>::spokes> roll_at_startup() {
+    return WheelShape<K>::roll();
   }
+};
 
-  long n = 0;
-  const uint64_t bases[5]{2, 3, 5, 7, 11};
-  const size_t base_size = prod(bases, 5);
-  uint64_t *pegs = new uint64_t[base_size];
-  const size_t peg_count = build_pegs(pegs, base_size, bases, 5);
-  auto start = steady_clock::now();
+template <size_t K>
+const std::array<uint8_t, WheelShape<K>::spokes> Wheel<K, false>::gaps =
+    Wheel<K, false>::roll_at_startup();
+
+/** @brief the wheel of no bases, visiting every number */
+template <> struct Wheel<0> {
+  static constexpr uint64_t size = 1;
+  static constexpr size_t spokes = 1;
+  static constexpr std::array<uint8_t, spokes> gaps{1};
+};
+
+/** @brief primes found and candidates tested by `find_primes` */
+struct prime_search {
+  uint64_t last = 0;
+  uint64_t candidates = 0;
+  uint64_t table_bytes = 0;
+};
+
+/**
+ * @brief finds the first `count` primes, testing only the numbers
+ * coprime to the first K primes
+ * @tparam K the `Wheel` to iterate candidates with
+ * @returns the last prime found and how many candidates were tested
+ */
+template <size_t K>
+prime_search find_primes(uint64_t count, prime_writer &primes) {
+  prime_search search{};
+  search.table_bytes = sizeof(Wheel<K>::gaps);
   uint64_t found = 0;
-  for (; found < 5; found++) {
-    std::cerr << bases[found] << std::endl;
+  for (; found < K && found < count; found++) {
+    search.last = WHEEL_BASES[found];
+    primes.put(search.last);
   }
-  for (; found < count; n += base_size) {
-    for (uint64_t i = 0; i < peg_count; i++) {
-      uint64_t val = n + pegs[i];
-      if (is_prime(val)) {
-        found++;
-        std::cerr << val << std::endl;
-        if (found == count) {
-          n = val;
+
+  uint64_t n = 1;
+  while (found < count) {
+    for (uint8_t gap : Wheel<K>::gaps) {
+      n += gap;
+      search.candidates++;
+      if (is_prime(n)) {
+        primes.put(n);
+        search.last = n;
+        if (++found == count) {
           break;
         }
       }
     }
   }
+  return search;
+}
+
+/** @brief `find_primes` for each wheel, indexed by its base count */
+template <size_t... K>
+constexpr std::array<prime_search (*)(uint64_t, prime_writer &),
+                     sizeof...(K)>
+wheel_table(std::index_sequence<K...>) {
+  return {find_primes<K>...};
+}
+
+void usage(const char *name) {
+  std::cerr << "usage: " << name
+            << " [--text | --binary | --none] [--output file] [--defer]"
+               " [--wheel 2|3|5|7|11|13|17] [count]"
+            << std::endl;
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  uint64_t count = 1000;
+  prime_format format = prime_format::text;
+  const char *output = nullptr;
+  bool defer = false;
+  size_t wheel = 5;
+  int arg = 1;
+  for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+    if (strcmp(argv[arg], "--text") == 0) {
+      format = prime_format::text;
+    } else if (strcmp(argv[arg], "--binary") == 0) {
+      format = prime_format::binary;
+    } else if (strcmp(argv[arg], "--none") == 0) {
+      format = prime_format::none;
+    } else if (strcmp(argv[arg], "--output") == 0 && arg + 1 < argc) {
+      output = argv[++arg];
+    } else if (strcmp(argv[arg], "--defer") == 0) {
+      defer = true;
+    } else if (strcmp(argv[arg], "--wheel") == 0 && arg + 1 < argc) {
+      // named by its largest base, 11 for the 2*3*5*7*11 wheel
+      uint64_t largest = strtol(argv[++arg], NULL, INT_RADIX_BASE);
+      wheel = 0;
+      while (wheel < MAX_WHEEL && WHEEL_BASES[wheel] != largest) {
+        wheel++;
+      }
+      if (wheel++ == MAX_WHEEL) {
+        usage(argv[0]);
+      }
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (arg < argc) {
+    count = strtol(argv[arg], NULL, INT_RADIX_BASE);
+  }
+
+  // primes go to stderr unless written to a file
+  int fd = STDERR_FILENO;
+  if (output != nullptr) {
+    fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      perror(output);
+      exit(EXIT_FAILURE);
+    }
+  }
+  prime_writer primes(fd, format, defer);
+
+  constexpr auto wheels =
+      wheel_table(std::make_index_sequence<MAX_WHEEL + 1>());
+  auto start = steady_clock::now();
+  prime_search search = wheels[wheel](count, primes);
+  if (!defer) {
+    primes.flush();
+  }
   auto time = steady_clock::now() - start;
-  std::cout << "Found the first " << count << " primes ending at " << n
-            << " in " << duration_cast<milliseconds>(time).count()
-            << "ms." << std::endl;
+  std::cout << "Found the first " << count << " primes ending at "
+            << search.last << " in "
+            << duration_cast<milliseconds>(time).count() << "ms."
+            << std::endl;
+  std::cout << "Tested " << search.candidates << " candidates with the "
+            << WHEEL_BASES[wheel - 1] << " wheel ("
+            << search.table_bytes << " byte gap table)." << std::endl;
+
+  // with --defer the primes wait in memory until the clock has stopped
+  if (defer) {
+    auto write_start = steady_clock::now();
+    primes.flush();
+    auto write_time = steady_clock::now() - write_start;
+    std::cout << "Wrote " << primes.bytes() << " bytes in "
+              << duration_cast<milliseconds>(write_time).count()
+              << "ms." << std::endl;
+  }
+  if (output != nullptr) {
+    close(fd);
+  }
 }
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "prime_stream.hh"
+
+using namespace std::chrono;
+
+/**
+ * @brief decodes a `prime_gen --binary` stream back to text, or
+ * summarizes it with --stats
+ */
+int main(int argc, char *argv[]) {
+  bool stats = false;
+  int arg = 1;
+  if (arg < argc && strcmp(argv[arg], "--stats") == 0) {
+    stats = true;
+    arg++;
+  }
+  if (argc - arg > 1 ||
+      (arg < argc && strncmp(argv[arg], "--", 2) == 0)) {
+    std::cerr << "usage: " << argv[0] << " [--stats] [file]"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // reads stdin without a file
+  int fd = STDIN_FILENO;
+  if (arg < argc) {
+    fd = open(argv[arg], O_RDONLY);
+    if (fd < 0) {
+      perror(argv[arg]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  prime_reader reader(fd);
+  prime_writer text(STDOUT_FILENO,
+                    stats ? prime_format::none : prime_format::text,
+                    false);
+  uint64_t count = 0;
+  uint64_t prime = 0;
+  uint64_t last = 0;
+  uint64_t max_gap = 0;
+  uint64_t max_gap_at = 0;
+  auto start = steady_clock::now();
+  while (reader.next(prime)) {
+    if (count > 0 && prime - last > max_gap) {
+      max_gap = prime - last;
+      max_gap_at = last;
+    }
+    text.put(prime);
+    last = prime;
+    count++;
+  }
+  text.flush();
+  auto time = duration<double>(steady_clock::now() - start).count();
+
+  if (stats) {
+    std::cout << "Read " << count << " primes ending at " << last
+              << " from " << reader.bytes() << " bytes ("
+              << (count > 0 ? static_cast<double>(reader.bytes()) / count
+                            : 0)
+              << " bytes/prime)." << std::endl;
+    std::cout << "Largest gap " << max_gap << " after " << max_gap_at
+              << "." << std::endl;
+    std::cout << "Decoded " << count / time / 1e6 << " M primes/sec, "
+              << reader.bytes() / time / 1e6 << " MB/s." << std::endl;
+  }
+  if (fd != STDIN_FILENO) {
+    close(fd);
+  }
+}
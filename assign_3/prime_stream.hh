@@ -0,0 +1,205 @@
+#ifndef PRIME_STREAM_HH
+#define PRIME_STREAM_HH
+
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+=========================================================================
+Prime streams shared by prime_gen and prime_read
+
+A binary stream is the 8 byte magic "PRIMEDV1" followed by the gap from
+each prime to the one before it (0 before the first) as an unsigned
+LEB128 varint: 7 bits per byte, low bits first, the high bit set on
+every byte but the last. The first gap over 127 follows 1357201, so a
+stream takes little more than one byte per prime against ~10 for text.
+=========================================================================
+*/
+
+constexpr char PRIME_MAGIC[8] = {'P', 'R', 'I', 'M',
+                                  'E', 'D', 'V', '1'};
+
+// bytes per read or write syscall
+constexpr size_t PRIME_BUFFER = 1 << 20;
+
+// most bytes one prime takes in either format
+constexpr size_t PRIME_MAX_BYTES = 24;
+
+/** @brief how `prime_writer` encodes primes */
+enum class prime_format { text, binary, none };
+
+/**
+ * @brief appends `value` as an unsigned LEB128 varint
+ * @returns the byte after the varint
+ */
+inline uint8_t *put_varint(uint8_t *out, uint64_t value) {
+  while (value >= 0x80) {
+    *out++ = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  *out++ = static_cast<uint8_t>(value);
+  return out;
+}
+
+/**
+ * @brief encodes primes into a large buffer written with one syscall
+ * per `PRIME_BUFFER` bytes
+ * @note a deferred writer grows its buffer instead of writing, so no
+ * I/O happens until `flush`
+ */
+class prime_writer {
+  int fd_;
+  prime_format format_;
+  bool defer_;
+  std::vector<uint8_t> buf_;
+  size_t used_ = 0;
+  uint64_t last_ = 0;
+  uint64_t bytes_ = 0;
+
+  void write_all(const uint8_t *data, size_t len) {
+    while (len > 0) {
+      ssize_t done = write(fd_, data, len);
+      if (done < 0 && errno == EINTR) {
+        continue;
+      }
+      if (done <= 0) {
+        perror("write");
+        exit(EXIT_FAILURE);
+      }
+      data += done;
+      len -= static_cast<size_t>(done);
+    }
+  }
+
+public:
+  prime_writer(int fd, prime_format format, bool defer)
+      : fd_(fd), format_(format), defer_(defer), buf_(PRIME_BUFFER) {
+    if (format_ == prime_format::binary) {
+      std::memcpy(buf_.data(), PRIME_MAGIC, sizeof(PRIME_MAGIC));
+      used_ = sizeof(PRIME_MAGIC);
+    }
+  }
+
+  prime_writer(const prime_writer &) = delete;
+  prime_writer &operator=(const prime_writer &) = delete;
+
+  /** @brief appends the next prime, which must exceed the last */
+  void put(uint64_t prime) {
+    if (format_ == prime_format::none) {
+      return;
+    }
+    if (buf_.size() - used_ < PRIME_MAX_BYTES) {
+      if (defer_) {
+        buf_.resize(buf_.size() * 2);
+      } else {
+        flush();
+      }
+    }
+    uint8_t *out = buf_.data() + used_;
+    if (format_ == prime_format::binary) {
+      out = put_varint(out, prime - last_);
+      last_ = prime;
+    } else {
+      char *text = reinterpret_cast<char *>(out);
+      text = std::to_chars(text, text + PRIME_MAX_BYTES, prime).ptr;
+      *text++ = '\n';
+      out = reinterpret_cast<uint8_t *>(text);
+    }
+    used_ = static_cast<size_t>(out - buf_.data());
+  }
+
+  /** @brief writes out everything buffered so far */
+  void flush() {
+    write_all(buf_.data(), used_);
+    bytes_ += used_;
+    used_ = 0;
+  }
+
+  /** @brief bytes written by `flush` so far */
+  uint64_t bytes() const { return bytes_; }
+};
+
+/** @brief decodes a binary stream read `PRIME_BUFFER` bytes at once */
+class prime_reader {
+  int fd_;
+  std::vector<uint8_t> buf_;
+  size_t pos_ = 0;
+  size_t len_ = 0;
+  uint64_t last_ = 0;
+  uint64_t bytes_ = 0;
+
+  /** @returns the next byte, or -1 at the end of the stream */
+  int byte() {
+    if (pos_ == len_) {
+      ssize_t got;
+      do {
+        got = read(fd_, buf_.data(), buf_.size());
+      } while (got < 0 && errno == EINTR);
+      if (got < 0) {
+        perror("read");
+        exit(EXIT_FAILURE);
+      }
+      bytes_ += static_cast<uint64_t>(got);
+      pos_ = 0;
+      len_ = static_cast<size_t>(got);
+      if (len_ == 0) {
+        return -1;
+      }
+    }
+    return buf_[pos_++];
+  }
+
+public:
+  /** @note exits if the stream does not start with `PRIME_MAGIC` */
+  explicit prime_reader(int fd) : fd_(fd), buf_(PRIME_BUFFER) {
+    for (char expected : PRIME_MAGIC) {
+      if (byte() != static_cast<uint8_t>(expected)) {
+        std::cerr << "not a binary prime stream" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+
+  prime_reader(const prime_reader &) = delete;
+  prime_reader &operator=(const prime_reader &) = delete;
+
+  /**
+   * @brief decodes the next prime
+   * @returns false at the end of the stream
+   * @note exits on a varint cut off by the end of the stream
+   */
+  bool next(uint64_t &prime) {
+    int b = byte();
+    if (b < 0) {
+      return false;
+    }
+    uint64_t gap = 0;
+    int shift = 0;
+    for (; b & 0x80; shift += 7) {
+      gap |= static_cast<uint64_t>(b & 0x7f) << shift;
+      b = byte();
+      if (b < 0 || shift > 56) {
+        std::cerr << "truncated or corrupt prime stream" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+    gap |= static_cast<uint64_t>(b) << shift;
+    last_ += gap;
+    prime = last_;
+    return true;
+  }
+
+  /** @brief bytes read so far, including the magic */
+  uint64_t bytes() const { return bytes_; }
+};
+
+#endif
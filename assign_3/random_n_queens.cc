@@ -1,9 +1,21 @@
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include "stopwatch.hh"
+
 /*
 =========================================================================
 Back tracking solutions and classes for NQueens problem
@@ -15,9 +27,6 @@ constexpr long UNKNOWN = -1;
 
 using namespace std::chrono;
 
-// For stopwatch<>::timeit()...
-using process = void (*)(void *);
-
 /**
  * @brief Abstract base class for problems solved via backtracking
  * @tparam C representation type of a partial solution to the problem
@@ -47,6 +56,111 @@ public:
   virtual std::vector<C> extensions(C candidate) = 0;
 };
 
+/**
+ * @brief Abstract base class for problems backtracked in place
+ * @note the problem owns a single mutable partial solution. Moves are
+ * applied with `push` and undone with `pop`, so no candidate is copied
+ * @tparam M representation of one move extending the partial solution
+ */
+template <typename M> class IncrementalProblem {
+public:
+  /**
+   * @brief push applies `move` to the partial solution
+   * @param move a move given by `first_move` or `next_move`
+   */
+  virtual void push(M move) = 0;
+
+  /** @brief pop undoes the most recent `push` */
+  virtual void pop() = 0;
+
+  /**
+   * @brief reject checks the newest move against the rest of the state
+   * @note the state before the newest move is known not to be rejected
+   * @returns `true` if no solutions can be extended from the state
+   */
+  virtual bool reject() = 0;
+
+  /**
+   * @brief accept checks for completeness of the partial solution
+   * @returns `true` only if the state is completely defined and valid
+   */
+  virtual bool accept() = 0;
+
+  /**
+   * @brief first_move gives the first move extending the state
+   * @param move set to the first extension
+   * @returns `false` if the state cannot be extended
+   */
+  virtual bool first_move(M &move) = 0;
+
+  /**
+   * @brief next_move advances `move` to its next sibling extension
+   * @param move the current extension, replaced by the next one
+   * @returns `false` once every extension has been given
+   */
+  virtual bool next_move(M &move) = 0;
+};
+
+/**
+ * @brief sums `work(task)` over every task using a pool of threads
+ * @note a shared queue per worker rather than deques with stealing:
+ * each worker owns a contiguous slice of `tasks` claimed one at a time
+ * through the slice's atomic cursor, and a worker that empties its own
+ * slice claims from the others' cursors in turn. Cursors and per worker
+ * sums sit alone on their own cache lines, so only threads claiming
+ * from the same slice contend and no locks are taken.
+ * @param tasks independent pieces of work, e.g. search subtrees
+ * @param threads number of workers to run
+ * @param work callable returning the count for one task
+ * @returns the total of `work` over all `tasks`
+ */
+template <typename Task, typename Work>
+unsigned long parallel_sum(const std::vector<Task> &tasks,
+                           unsigned threads, Work work) {
+  struct alignas(64) Cursor {
+    std::atomic<size_t> next{0};
+  };
+  struct alignas(64) Sum {
+    unsigned long value = 0;
+  };
+
+  threads = std::max(1U, threads);
+  auto begin = [&](unsigned id) { return tasks.size() * id / threads; };
+  std::vector<Cursor> cursors(threads);
+  std::vector<Sum> sums(threads);
+  for (unsigned id = 0; id < threads; id++) {
+    cursors[id].next = begin(id);
+  }
+
+  auto worker = [&](unsigned id) {
+    unsigned long sum = 0;
+    for (unsigned k = 0; k < threads; k++) {
+      unsigned victim = (id + k) % threads;
+      size_t end = begin(victim + 1);
+      size_t idx;
+      while ((idx = cursors[victim].next.fetch_add(1)) < end) {
+        sum += work(tasks[idx]);
+      }
+    }
+    sums[id].value = sum;
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned id = 1; id < threads; id++) {
+    pool.emplace_back(worker, id);
+  }
+  worker(0);
+  for (auto &t : pool) {
+    t.join();
+  }
+
+  unsigned long total = 0;
+  for (auto &sum : sums) {
+    total += sum.value;
+  }
+  return total;
+}
+
 /**
  * @brief Backtracking search problem solver framework
  * @tparam T Subclass of `SearchProblem<C>`. represents the solver
@@ -55,6 +169,10 @@ public:
 template <class T, typename C> class Backtrack {
 private:
   T problem;
+  unsigned long nodes_ = 0;
+  // `first` gives up once this passes, checked every 4096 nodes
+  steady_clock::time_point deadline_ = steady_clock::time_point::max();
+  bool timed_out_ = false;
 
 public:
   /**
@@ -84,12 +202,64 @@ public:
     }
 
     for (auto &ext : problem.extensions(candidate)) {
-      std::inserter(std::end(solutions), std::begin(ext), std::end(ext));
+      auto found = this->solutions(ext);
+      solutions.insert(solutions.end(), found.begin(), found.end());
     }
 
     return solutions;
   }
 
+  /**
+   * @brief counts all solutions extending a starting candidate
+   * @param candidate (partial) solution to base as search starting point
+   * @returns number of solutions that extend `candidate`
+   */
+  unsigned long count(C candidate) {
+    if (problem.reject(candidate)) {
+      return 0;
+    }
+
+    unsigned long found = problem.accept(candidate) ? 1 : 0;
+    for (auto &ext : problem.extensions(candidate)) {
+      found += count(ext);
+    }
+    return found;
+  }
+
+  /**
+   * @brief counts all solutions extending `candidate` across threads
+   * @note the tree is split into the subtrees rooted `split_depth`
+   * levels below `candidate`, which are counted by `parallel_sum`
+   * @param candidate (partial) solution to base as search starting point
+   * @param split_depth levels expanded serially before splitting
+   * @param threads number of workers to count subtrees with
+   * @returns number of solutions that extend `candidate`
+   */
+  unsigned long count(C candidate, int split_depth, unsigned threads) {
+    std::vector<C> frontier{candidate};
+    unsigned long found = 0;
+
+    for (int depth = 0; depth < split_depth; depth++) {
+      std::vector<C> next{};
+      for (auto &node : frontier) {
+        if (problem.reject(node)) {
+          continue;
+        }
+        if (problem.accept(node)) {
+          found++;
+        }
+        for (auto &ext : problem.extensions(node)) {
+          next.emplace_back(ext);
+        }
+      }
+      frontier.swap(next);
+    }
+
+    return found + parallel_sum(frontier, threads, [](const C &node) {
+             return Backtrack<T, C>{}.count(node);
+           });
+  }
+
   /**
    * @brief finds first (possibly null) solution extension to `candidate`
    * @note Similar to BFS or Beam-search-eqsue searches
@@ -98,7 +268,12 @@ public:
    * @returns true if and only if solution is found, otherwise, false
    */
   bool first(C &solution, C candidate) {
-    if (problem.reject(candidate)) {
+    if (timed_out_ || problem.reject(candidate)) {
+      return false;
+    }
+    nodes_++;
+    if ((nodes_ & 4095) == 0 && steady_clock::now() > deadline_) {
+      timed_out_ = true;
       return false;
     }
 
@@ -115,6 +290,102 @@ public:
 
     return false;
   }
+
+  /** @brief number of unrejected candidates visited by `first` */
+  unsigned long nodes() const { return nodes_; }
+
+  /** @brief makes `first` give up once `budget` from now has passed */
+  void time_limit(steady_clock::duration budget) {
+    deadline_ = steady_clock::now() + budget;
+    timed_out_ = false;
+  }
+
+  /** @brief whether `first` gave up at its time limit */
+  bool timed_out() const { return timed_out_; }
+};
+
+/**
+ * @brief Backtracking solver framework for in-place search problems
+ * @note calls go to `T` directly, so `final` overrides are devirtualized
+ * @tparam T Subclass of `IncrementalProblem<M>`. represents the solver
+ * @tparam M representation of moves in the search space
+ */
+template <class T, typename M> class IncrementalBacktrack {
+private:
+  T problem;
+  unsigned long nodes_ = 0;
+
+  bool search() {
+    if (problem.accept()) {
+      return true;
+    }
+
+    M move;
+    for (bool more = problem.first_move(move); more;
+         more = problem.next_move(move)) {
+      problem.push(move);
+      if (!problem.reject()) {
+        nodes_++;
+        if (search()) {
+          return true;
+        }
+      }
+      problem.pop();
+    }
+    return false;
+  }
+
+  unsigned long tally() {
+    if (problem.accept()) {
+      return 1;
+    }
+
+    unsigned long found = 0;
+    M move;
+    for (bool more = problem.first_move(move); more;
+         more = problem.next_move(move)) {
+      problem.push(move);
+      if (!problem.reject()) {
+        found += tally();
+      }
+      problem.pop();
+    }
+    return found;
+  }
+
+public:
+  /**
+   * @brief constructs the problem from `args` and typechecks it
+   */
+  template <typename... Args>
+  explicit IncrementalBacktrack(Args &&...args)
+      : problem(std::forward<Args>(args)...) {
+    static_assert(std::is_base_of<IncrementalProblem<M>, T>::value,
+                  "IncrementalBacktrack template argument must derive "
+                  "from IncrementalProblem");
+  }
+
+  /** @brief the problem state, holding the solution after `first` */
+  T &state() { return problem; }
+
+  /**
+   * @brief extends the current state in place to its first solution
+   * @note the state is restored if no solution is found
+   * @returns true if and only if solution is found, otherwise, false
+   */
+  bool first() {
+    nodes_++;
+    return search();
+  }
+
+  /**
+   * @brief counts all solutions extending the current state
+   * @returns number of solutions, leaving the state unchanged
+   */
+  unsigned long count() { return tally(); }
+
+  /** @brief number of unrejected states visited by `first` */
+  unsigned long nodes() const { return nodes_; }
 };
 
 /**
@@ -196,109 +467,1007 @@ public:
 };
 
 /**
- * @brief Stopwatch with timer for process functions
- * @tparam Clock the system clock to use for timing resolutions
+ * @brief NQueens as an in-place problem placing one rank per move
+ * @note queens per file and diagonal are counted, so `reject` only looks
+ * at the three lines through the newest queen
+ * @tparam N the square dimension (`N` x `N`) size of the grid/chessboard
  */
-template <typename Clock = std::chrono::steady_clock> class stopwatch {
-  typename Clock::time_point last_;
+template <long N>
+class IncrementalNQueens final : public IncrementalProblem<long> {
+  std::array<long, N> ranks_{};
+  std::array<unsigned char, N> files_{};
+  std::array<unsigned char, 2 * N - 1> diags_{};
+  std::array<unsigned char, 2 * N - 1> antidiags_{};
+  long depth_ = 0;
 
 public:
-  stopwatch() : last_(Clock::now()) {}
+  void push(long file) final {
+    ranks_[depth_] = file;
+    files_[file]++;
+    diags_[depth_ + file]++;
+    antidiags_[depth_ - file + N - 1]++;
+    depth_++;
+  }
+
+  void pop() final {
+    depth_--;
+    long file = ranks_[depth_];
+    files_[file]--;
+    diags_[depth_ + file]--;
+    antidiags_[depth_ - file + N - 1]--;
+  }
+
+  bool reject() final {
+    long rank = depth_ - 1;
+    long file = ranks_[rank];
+    return files_[file] > 1 || diags_[rank + file] > 1 ||
+           antidiags_[rank - file + N - 1] > 1;
+  }
+
+  bool accept() final { return depth_ == N; }
+
+  bool first_move(long &file) final {
+    file = 0;
+    return depth_ < N;
+  }
+
+  bool next_move(long &file) final { return ++file < N; }
+
+  /** @brief the placed queens, `UNKNOWN` on ranks not yet reached */
+  std::array<long, N> candidate() const {
+    std::array<long, N> placed{};
+    placed.fill(UNKNOWN);
+    std::copy(ranks_.begin(), ranks_.begin() + depth_, placed.begin());
+    return placed;
+  }
+};
+
+/**
+ * @brief NQueens in place with the board size chosen at runtime
+ * @note same moves and checks as `IncrementalNQueens<N>`
+ */
+class DynamicNQueens final : public IncrementalProblem<long> {
+  long n_;
+  std::vector<long> ranks_;
+  std::vector<unsigned char> files_;
+  std::vector<unsigned char> diags_;
+  std::vector<unsigned char> antidiags_;
+  long depth_ = 0;
+
+public:
+  /** @param n the square dimension (`n` x `n`) size of the board */
+  explicit DynamicNQueens(long n)
+      : n_(n), ranks_(n), files_(n), diags_(2 * n - 1),
+        antidiags_(2 * n - 1) {}
+
+  void push(long file) final {
+    ranks_[depth_] = file;
+    files_[file]++;
+    diags_[depth_ + file]++;
+    antidiags_[depth_ - file + n_ - 1]++;
+    depth_++;
+  }
+
+  void pop() final {
+    depth_--;
+    long file = ranks_[depth_];
+    files_[file]--;
+    diags_[depth_ + file]--;
+    antidiags_[depth_ - file + n_ - 1]--;
+  }
 
-  /** @brief resets the stopwatch */
-  void reset() { last_ = Clock::now(); }
+  bool reject() final {
+    long rank = depth_ - 1;
+    long file = ranks_[rank];
+    return files_[file] > 1 || diags_[rank + file] > 1 ||
+           antidiags_[rank - file + n_ - 1] > 1;
+  }
+
+  bool accept() final { return depth_ == n_; }
+
+  bool first_move(long &file) final {
+    file = 0;
+    return depth_ < n_;
+  }
 
+  bool next_move(long &file) final { return ++file < n_; }
+
+  /** @brief number of ranks holding a queen */
+  long depth() const { return depth_; }
+
+  /** @brief the placed queens, one file per filled rank */
+  std::vector<long> candidate() const {
+    return std::vector<long>(ranks_.begin(), ranks_.begin() + depth_);
+  }
+};
+
+/** @brief a CSP move: the value given to one variable */
+struct Assignment {
+  long var;
+  long value;
+};
+
+/**
+ * @brief binary constraint satisfaction problem solved in place
+ * @note domains are bitsets of at most 64 values. Assigning a variable
+ * forward checks the domains of its unassigned neighbours, and the next
+ * variable is picked by minimum remaining values, then by the number of
+ * unassigned neighbours it constrains.
+ * @tparam Constraint callable `(xi, vi, xj, vj)` that is `true` when
+ * `xi = vi` and `xj = vj` are consistent. Only called for neighbours.
+ */
+template <class Constraint>
+class CSP final : public IncrementalProblem<Assignment> {
+  Constraint consistent_;
+  std::vector<std::vector<long>> neighbours_;
+  std::vector<uint64_t> domains_;
+  std::vector<long> values_;
+
+  // Unassigned neighbours of each variable, for the degree tie-break
+  std::vector<size_t> degrees_;
+
+  // Domains overwritten since the search started, restored by `pop`
+  std::vector<std::pair<long, uint64_t>> trail_;
+  std::vector<size_t> frames_;
+  std::vector<long> order_;
+  bool wiped_ = false;
+
+  void narrow(long var, uint64_t domain) {
+    trail_.emplace_back(var, domains_[var]);
+    domains_[var] = domain;
+  }
+
+public:
   /**
-   * @brief gives elapsed duration since last reset or construction
-   * @returns stopwatch time elapsed as `Clock::duration`
+   * @param domains initial set of values allowed for each variable
+   * @param neighbours for each variable, the variables it constrains;
+   * `j` must list `i` whenever `i` lists `j`
+   * @param consistent the binary constraint between neighbours
    */
-  typename Clock::duration elapsed() const {
-    return Clock::now() - last_;
+  CSP(std::vector<uint64_t> domains,
+      std::vector<std::vector<long>> neighbours, Constraint consistent)
+      : consistent_(consistent), neighbours_(std::move(neighbours)),
+        domains_(std::move(domains)), values_(domains_.size(), UNKNOWN),
+        degrees_(domains_.size()) {
+    for (size_t var = 0; var < degrees_.size(); var++) {
+      degrees_[var] = neighbours_[var].size();
+    }
+  }
+
+  void push(Assignment move) final {
+    frames_.push_back(trail_.size());
+    order_.push_back(move.var);
+    values_[move.var] = move.value;
+    narrow(move.var, 1ULL << move.value);
+    for (long other : neighbours_[move.var]) {
+      degrees_[other]--;
+    }
+
+    for (long other : neighbours_[move.var]) {
+      if (values_[other] != UNKNOWN) {
+        continue;
+      }
+
+      uint64_t kept = 0;
+      for (uint64_t open = domains_[other]; open; open &= open - 1) {
+        long value = __builtin_ctzll(open);
+        if (consistent_(move.var, move.value, other, value)) {
+          kept |= 1ULL << value;
+        }
+      }
+
+      if (kept != domains_[other]) {
+        narrow(other, kept);
+      }
+      if (kept == 0) {
+        wiped_ = true;
+        return;
+      }
+    }
+  }
+
+  void pop() final {
+    for (size_t mark = frames_.back(); trail_.size() > mark;) {
+      domains_[trail_.back().first] = trail_.back().second;
+      trail_.pop_back();
+    }
+    frames_.pop_back();
+    for (long other : neighbours_[order_.back()]) {
+      degrees_[other]++;
+    }
+    values_[order_.back()] = UNKNOWN;
+    order_.pop_back();
+    wiped_ = false;
+  }
+
+  bool reject() final { return wiped_; }
+
+  bool accept() final { return order_.size() == values_.size(); }
+
+  bool first_move(Assignment &move) final {
+    long best = UNKNOWN;
+    int best_size = 65;
+    size_t best_degree = 0;
+    for (size_t var = 0; var < values_.size(); var++) {
+      if (values_[var] != UNKNOWN) {
+        continue;
+      }
+      int size = __builtin_popcountll(domains_[var]);
+      size_t degree = degrees_[var];
+      if (size < best_size || (size == best_size && degree > best_degree)) {
+        best = var;
+        best_size = size;
+        best_degree = degree;
+      }
+    }
+
+    if (best == UNKNOWN || domains_[best] == 0) {
+      return false;
+    }
+    move = {best, __builtin_ctzll(domains_[best])};
+    return true;
+  }
+
+  bool next_move(Assignment &move) final {
+    uint64_t above = domains_[move.var] & ~((2ULL << move.value) - 1);
+    if (move.value == 63 || above == 0) {
+      return false;
+    }
+    move.value = __builtin_ctzll(above);
+    return true;
+  }
+
+  /** @brief value of each variable, `UNKNOWN` while unassigned */
+  const std::vector<long> &values() const { return values_; }
+};
+
+/** @brief N queens constraint: no shared file or diagonal */
+struct QueensConstraint {
+  bool operator()(long ri, long fi, long rj, long fj) const {
+    return fi != fj && std::abs(fi - fj) != std::abs(ri - rj);
+  }
+};
+
+/**
+ * @brief builds N queens as a CSP with one variable per rank
+ * @param n the square dimension of the board, at most 64
+ */
+CSP<QueensConstraint> queens_csp(long n) {
+  std::vector<uint64_t> domains(n, n == 64 ? ~0ULL : (1ULL << n) - 1);
+  std::vector<std::vector<long>> neighbours(n);
+  for (long rank = 0; rank < n; rank++) {
+    for (long other = 0; other < n; other++) {
+      if (other != rank) {
+        neighbours[rank].push_back(other);
+      }
+    }
+  }
+  return CSP<QueensConstraint>(domains, neighbours, QueensConstraint{});
+}
+
+/**
+ * @brief NQueens by min-conflicts local search (Las Vegas repair)
+ * @note queens stay a permutation of the files, one per rank, so only
+ * diagonals can conflict. Queens per diagonal are counted, making the
+ * change in collisions of swapping two ranks O(1). A greedy start places
+ * all but the last few ranks free of collisions, then each conflicted
+ * queen moves to a file where it has the fewest conflicts, ties broken at
+ * random, by swapping with the rank holding that file.
+ */
+class MinConflictQueens {
+  long n_;
+  std::vector<long> files_;
+  std::vector<long> ranks_;
+  std::vector<long> ties_;
+  std::vector<unsigned> diags_;
+  std::vector<unsigned> antidiags_;
+  long collisions_ = 0;
+  std::mt19937_64 rng_;
+
+  // Ranks left to random placement by the greedy start
+  static constexpr long RANDOM_TAIL = 50;
+
+  // Random files tried per rank before accepting a collision
+  static constexpr long TRIES = 1000;
+
+  // Queens moved by one repair before restarting from a new start
+  static constexpr long REPAIR_STEPS = 1000;
+
+  long random(long below) { return static_cast<long>(rng_() % below); }
+
+  void add(long rank) {
+    long file = files_[rank];
+    collisions_ += diags_[rank + file]++ > 0;
+    collisions_ += antidiags_[rank - file + n_ - 1]++ > 0;
+  }
+
+  void remove(long rank) {
+    long file = files_[rank];
+    collisions_ -= --diags_[rank + file] > 0;
+    collisions_ -= --antidiags_[rank - file + n_ - 1] > 0;
+  }
+
+  bool conflicted(long rank) const {
+    long file = files_[rank];
+    return diags_[rank + file] > 1 || antidiags_[rank - file + n_ - 1] > 1;
+  }
+
+  /** @brief queens sharing a diagonal with `rank` if it moved to `file` */
+  long conflicts(long rank, long file) const {
+    long self = file == files_[rank] ? 2 : 0;
+    return static_cast<long>(diags_[rank + file]) +
+           static_cast<long>(antidiags_[rank - file + n_ - 1]) - self;
+  }
+
+  void swap(long a, long b) {
+    remove(a);
+    remove(b);
+    std::swap(files_[a], files_[b]);
+    ranks_[files_[a]] = a;
+    ranks_[files_[b]] = b;
+    add(a);
+    add(b);
   }
 
   /**
-   * @brief returns elapsed time and resets stopwatch
-   * @returns elapsed stopwatch time of tick
+   * @brief conflicts of the queen displaced when `rank` swaps into `file`
+   * @note it lands on the file `rank` leaves, next to `rank` on `file`
    */
-  typename Clock::duration tick() {
-    auto now = Clock::now();
-    auto elapsed = now - last_;
-    last_ = now;
-    return elapsed;
+  long displaced_conflicts(long rank, long file) const {
+    long other = ranks_[file];
+    long left = files_[rank];
+    if (other == rank) {
+      return 0;
+    }
+    return static_cast<long>(diags_[other + left]) +
+           static_cast<long>(antidiags_[other - left + n_ - 1]) +
+           (rank + file == other + left) + (rank - file == other - left);
   }
 
   /**
-   * @brief runs trials of processes. similar to python3 -m timeit module
-   * @param trials How many trials to run the repeated process
-   * @param loops number of looped repitions per time trial
-   * @param proc the process/function to run in a trial
-   * @param process_args the arguments to pass to the process each time
-   * @returns fastest/minimal time taken by one trial of the trials done
+   * @brief file with the fewest conflicts for the queen on `rank`
+   * @note the diagonal counters along the rank are scanned in order.
+   * Ties go to a random file whose displaced queen lands with the fewest
+   * conflicts, trying tied files in random order until one lands free.
    */
-  typename Clock::duration timeit(long trials, long loops, process proc,
-                                  void *process_args) {
-    typename Clock::duration best;
+  long least_conflicted_file(long rank) {
+    long fewest = LONG_MAX;
+    for (long file = 0; file < n_; file++) {
+      long count = conflicts(rank, file);
+      if (count < fewest) {
+        fewest = count;
+        ties_.clear();
+      }
+      if (count == fewest) {
+        ties_.push_back(file);
+      }
+    }
 
-    for (int trial = 0; trial < trials; trial++) {
-      reset();
+    long best = ties_.front();
+    long best_displaced = LONG_MAX;
+    while (!ties_.empty() && best_displaced > 0) {
+      long pick = random(static_cast<long>(ties_.size()));
+      long file = ties_[pick];
+      ties_[pick] = ties_.back();
+      ties_.pop_back();
+      long displaced = displaced_conflicts(rank, file);
+      if (displaced < best_displaced) {
+        best = file;
+        best_displaced = displaced;
+      }
+    }
+    return best;
+  }
 
-      // repeatedly run proc. ignore result for timing
-      for (int loop = 0; loop < loops; loop++)
-        proc(process_args);
+  /** @brief greedy start: random collision-free files for most ranks */
+  void scatter() {
+    std::iota(files_.begin(), files_.end(), 0);
+    std::fill(diags_.begin(), diags_.end(), 0);
+    std::fill(antidiags_.begin(), antidiags_.end(), 0);
+    collisions_ = 0;
 
-      best = std::min(best, tick());
+    long tail = std::min(n_, RANDOM_TAIL);
+    for (long rank = 0; rank < n_ - tail; rank++) {
+      bool placed = false;
+      for (long tries = 0; tries < TRIES && !placed; tries++) {
+        std::swap(files_[rank], files_[rank + random(n_ - rank)]);
+        add(rank);
+        placed = !conflicted(rank);
+        if (!placed) {
+          remove(rank);
+        }
+      }
+      if (!placed) {
+        add(rank);
+      }
     }
+    for (long rank = n_ - tail; rank < n_; rank++) {
+      std::swap(files_[rank], files_[rank + random(n_ - rank)]);
+      add(rank);
+    }
+    for (long rank = 0; rank < n_; rank++) {
+      ranks_[files_[rank]] = rank;
+    }
+  }
 
-    std::cout << loops << " loops, best of " << trials << " trials: "
-              << duration_cast<std::chrono::microseconds>(best).count()
-              << " usec per trial" << std::endl;
+  /** @brief repairs conflicted ranks until none remain or steps run out */
+  bool repair(long steps) {
+    while (collisions_ > 0 && steps > 0) {
+      for (long rank = 0; rank < n_ && collisions_ > 0 && steps > 0;
+           rank++) {
+        if (conflicted(rank)) {
+          swap(rank, ranks_[least_conflicted_file(rank)]);
+          steps--;
+        }
+      }
+    }
+    return collisions_ == 0;
+  }
 
-    return best;
+public:
+  /**
+   * @param n the square dimension (`n` x `n`) size of the board
+   * @param seed seeds the random starts and swaps
+   */
+  explicit MinConflictQueens(long n, uint64_t seed = std::random_device{}())
+      : n_(n), files_(n), ranks_(n), diags_(2 * n - 1),
+        antidiags_(2 * n - 1), rng_(seed) {}
+
+  /**
+   * @brief solves the board, restarting when repair stalls
+   * @returns number of random starts before success, or 0 for the
+   * boards without a solution (n = 2 and n = 3)
+   */
+  int solve() {
+    if (n_ == 2 || n_ == 3) {
+      return 0;
+    }
+    int attempts = 0;
+    do {
+      attempts++;
+      scatter();
+    } while (!repair(REPAIR_STEPS));
+    return attempts;
+  }
+
+  /** @brief file of the queen on each rank */
+  const std::vector<long> &files() const { return files_; }
+
+  /** @brief checks the board from scratch, independent of the counters */
+  bool valid() const {
+    std::vector<bool> seen(5 * n_, false);
+    for (long rank = 0; rank < n_; rank++) {
+      long file = files_[rank];
+      long cells[3] = {file, n_ + rank + file,
+                       4 * n_ + rank - file - 2};
+      for (long cell : cells) {
+        if (seen[cell]) {
+          return false;
+        }
+        seen[cell] = true;
+      }
+    }
+    return true;
+  }
+};
+
+/**
+ * @brief NQueens solver tracking attacked files and diagonals as bitmasks
+ * @note visits the same nodes in the same order as `Backtrack` over
+ * `NQueens<N>`, without copying candidates or allocating
+ * @tparam N the square dimension of the board, at most 64
+ */
+template <long N> class BitQueens {
+  static_assert(N > 0 && N <= 64, "BitQueens boards fit in 64 bits");
+  using Candidate = std::array<long, N>;
+
+  static constexpr uint64_t FULL = N == 64 ? ~0ULL : (1ULL << N) - 1;
+
+  Candidate placed_{};
+  unsigned long nodes_ = 0;
+
+  /**
+   * @brief places queens on ranks `rank`..N-1 depth-first
+   * @param cols files already holding a queen
+   * @param left files attacked on this rank along down-left diagonals
+   * @param right files attacked on this rank along down-right diagonals
+   * @returns true once every rank holds a queen
+   */
+  bool place(long rank, uint64_t cols, uint64_t left, uint64_t right) {
+    nodes_++;
+    if (rank == N) {
+      return true;
+    }
+
+    uint64_t open = FULL & ~(cols | left | right);
+    while (open) {
+      uint64_t bit = open & -open;
+      open ^= bit;
+      placed_[rank] = __builtin_ctzll(bit);
+      if (place(rank + 1, cols | bit, ((left | bit) << 1) & FULL,
+                (right | bit) >> 1)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+public:
+  /**
+   * @brief finds first solution extension to `candidate`
+   * @param solution the reference to the found solution
+   * @param candidate queens on a prefix of ranks, `UNKNOWN` after it
+   * @returns true if and only if solution is found, otherwise, false
+   */
+  bool first(Candidate &solution, Candidate candidate) {
+    uint64_t cols = 0;
+    uint64_t left = 0;
+    uint64_t right = 0;
+    long rank = 0;
+
+    for (; rank < N && candidate[rank] != UNKNOWN; rank++) {
+      uint64_t bit = 1ULL << candidate[rank];
+      if ((cols | left | right) & bit) {
+        return false;
+      }
+      placed_[rank] = candidate[rank];
+      cols |= bit;
+      left = ((left | bit) << 1) & FULL;
+      right = (right | bit) >> 1;
+    }
+
+    // the prefix is one node, as `Backtrack` visits it as one candidate
+    if (!place(rank, cols, left, right)) {
+      return false;
+    }
+    solution = placed_;
+    return true;
+  }
+
+  /** @brief number of unattacked placements visited by `first` */
+  unsigned long nodes() const { return nodes_; }
+
+  /**
+   * @brief counts solutions placing queens on ranks `rank`..N-1
+   * @param cols files already holding a queen
+   * @param left files attacked on this rank along down-left diagonals
+   * @param right files attacked on this rank along down-right diagonals
+   */
+  static unsigned long count(long rank, uint64_t cols, uint64_t left,
+                             uint64_t right) {
+    if (rank == N) {
+      return 1;
+    }
+
+    uint64_t open = FULL & ~(cols | left | right);
+    if (rank == N - 1) {
+      // only one file is left unoccupied on the last rank
+      return open != 0;
+    }
+
+    unsigned long found = 0;
+    while (open) {
+      uint64_t bit = open & -open;
+      open ^= bit;
+      found += count(rank + 1, cols | bit, ((left | bit) << 1) & FULL,
+                     (right | bit) >> 1);
+    }
+    return found;
+  }
+
+  /**
+   * @brief counts every solution of the board across threads
+   * @note solutions are mirrored across the middle file, so only queens
+   * on the left half of the first rank are searched and counted twice.
+   * A queen on the middle file of an odd board is its own mirror image.
+   * @param split_depth ranks placed serially before splitting into tasks
+   * @param threads number of workers to count subtrees with
+   * @returns number of solutions to N queens
+   */
+  static unsigned long count(long split_depth, unsigned threads) {
+    struct Subtree {
+      long rank;
+      uint64_t cols;
+      uint64_t left;
+      uint64_t right;
+      unsigned long weight;
+    };
+
+    std::vector<Subtree> frontier{};
+    for (long file = 0; file < (N + 1) / 2; file++) {
+      uint64_t bit = 1ULL << file;
+      unsigned long weight = (N % 2 == 1 && file == N / 2) ? 1 : 2;
+      frontier.push_back({1, bit, (bit << 1) & FULL, bit >> 1, weight});
+    }
+
+    unsigned long found = 0;
+    for (long depth = 1; depth < std::min(split_depth, N); depth++) {
+      std::vector<Subtree> next{};
+      for (auto &node : frontier) {
+        uint64_t open = FULL & ~(node.cols | node.left | node.right);
+        while (open) {
+          uint64_t bit = open & -open;
+          open ^= bit;
+          next.push_back({node.rank + 1, node.cols | bit,
+                          ((node.left | bit) << 1) & FULL,
+                          (node.right | bit) >> 1, node.weight});
+        }
+      }
+      frontier.swap(next);
+    }
+
+    for (auto &node : frontier) {
+      if (node.rank == N) {
+        found += node.weight;
+      }
+    }
+
+    return found +
+           parallel_sum(frontier, threads, [](const Subtree &node) {
+             return node.rank == N ? 0
+                                   : node.weight * count(node.rank,
+                                                         node.cols,
+                                                         node.left,
+                                                         node.right);
+           });
   }
 };
 
 /**
  * @brief finds a solution to NQueens based off random  starting point
+ * @tparam N the square dimension of the board
+ * @tparam Solver any solver with `first(solution, candidate)`
+ * @param solver the solver to search with
  * @param start_count number of pieces to randomly place as start
  * @returns number of attempts of randomly placing pieces before success
  */
-int find_random(int start_count) {
-  using eight_queens = std::array<long, 8>;
-  Backtrack<NQueens<8>, eight_queens> b{};
-  eight_queens solution;
-  eight_queens start{};
+template <long N, class Solver>
+int find_random(Solver &solver, int start_count) {
+  using Candidate = std::array<long, N>;
+  Candidate solution;
+  Candidate start{};
   int attempts = 0;
   do {
     attempts++;
     for (int idx = 0; idx < start_count; idx++) {
-      start.at(idx) = rand() % 8;
+      start.at(idx) = rand() % N;
     }
-    for (int idx = start_count; idx < 8; idx++) {
+    for (int idx = start_count; idx < N; idx++) {
       start.at(idx) = UNKNOWN;
     }
-  } while (!b.first(solution, start));
+  } while (!solver.first(solution, start));
   return attempts;
 }
 
-/** @brief proccess wrapper of find_Random */
-void solve_proc(void *args) { find_random(*(int *)args); }
+/**
+ * @brief finds a solution to 8 queens based off random  starting point
+ * @param start_count number of pieces to randomly place as start
+ * @returns number of attempts of randomly placing pieces before success
+ */
+int find_random(int start_count) {
+  Backtrack<NQueens<8>, std::array<long, 8>> b{};
+  return find_random<8>(b, start_count);
+}
 
-int main(int /*argc*/, char * /*argv*/ []) {
-  using clock = std::chrono::steady_clock;
-  stopwatch<clock> sw;
+/**
+ * @brief finds a solution to n queens based off random starting point
+ * @param n the square dimension of the board, chosen at runtime
+ * @param start_count number of pieces to randomly place as start
+ * @returns number of attempts of randomly placing pieces before success
+ */
+int find_random(long n, int start_count) {
+  IncrementalBacktrack<DynamicNQueens, long> b{n};
+  int attempts = 0;
+  for (;;) {
+    attempts++;
+    bool rejected = false;
+    for (int idx = 0; idx < start_count; idx++) {
+      b.state().push(rand() % n);
+      rejected = rejected || b.state().reject();
+    }
+    if (!rejected && b.first()) {
+      return attempts;
+    }
+    for (int idx = 0; idx < start_count; idx++) {
+      b.state().pop();
+    }
+  }
+}
 
-  clock::duration best;
-  for (int count = 0; count < 8; count++) {
-    std::cout << count << " random pieces placed..." << std::endl;
+/**
+ * @brief prints search rate of a solver over random starts of the board
+ * @param name label for the solver in the report
+ * @param solver the solver to search with
+ * @param starts number of random starting boards to solve
+ * @param start_count number of pieces to randomly place as start
+ */
+template <long N, class Solver>
+void node_rate(const char *name, Solver &solver, int starts,
+               int start_count) {
+  stopwatch<> sw;
+  long attempts = 0;
+  for (int run = 0; run < starts; run++) {
+    attempts += find_random<N>(solver, start_count);
+  }
+  double secs = duration<double>(sw.elapsed()).count();
+  std::cout << "  " << name << ": " << solver.nodes() << " nodes, "
+            << attempts << " attempts, "
+            << static_cast<long>(solver.nodes() / secs) << " nodes/sec"
+            << std::endl;
+}
+
+/**
+ * @brief compares the bitmask solver against backtracking on N queens
+ * @note the copying backtracker is only run while it finishes quickly
+ */
+template <long N> void compare_solvers(int start_count) {
+  constexpr int starts = 20;
+  std::cout << N << " queens, " << start_count
+            << " random pieces placed..." << std::endl;
+
+  if (N <= 16) {
+    Backtrack<NQueens<N>, std::array<long, N>> b{};
+    node_rate<N>("backtrack", b, starts, start_count);
+  }
+  BitQueens<N> bits{};
+  node_rate<N>("bitmask", bits, starts, start_count);
+}
+
+/**
+ * @brief times the first solution from an empty board by copying and
+ * by in-place backtracking
+ */
+template <long N> void compare_in_place() {
+  using Candidate = std::array<long, N>;
+  std::cout << N << " queens, first solution..." << std::endl;
+
+  Candidate empty{};
+  empty.fill(UNKNOWN);
+  Candidate solution{};
+  stopwatch<> sw;
+  Backtrack<NQueens<N>, Candidate> copying{};
+  copying.first(solution, empty);
+  double secs = duration<double>(sw.tick()).count();
+  std::cout << "  copying: " << copying.nodes() << " nodes, "
+            << static_cast<long>(copying.nodes() / secs) << " nodes/sec"
+            << std::endl;
+
+  IncrementalBacktrack<IncrementalNQueens<N>, long> in_place{};
+  in_place.first();
+  secs = duration<double>(sw.tick()).count();
+  std::cout << "  in place: " << in_place.nodes() << " nodes, "
+            << static_cast<long>(in_place.nodes() / secs) << " nodes/sec"
+            << (in_place.state().candidate() == solution ? ""
+                                                         : " MISMATCH")
+            << std::endl;
+}
+
+/**
+ * @brief runs `solve` and prints its time and node rate
+ * @param solve callable returning the number of nodes it visited
+ */
+template <typename Solve> void report_first(const char *name, Solve solve) {
+  stopwatch<> sw;
+  unsigned long nodes = solve();
+  double secs = duration<double>(sw.elapsed()).count();
+  std::cout << "  " << name << ": " << nodes << " nodes in "
+            << duration_cast<microseconds>(sw.elapsed()).count()
+            << "us, " << static_cast<long>(nodes / secs) << " nodes/sec"
+            << std::endl;
+}
+
+/**
+ * @brief first solution of a runtime sized board by in-place
+ * backtracking and by the forward checking CSP solver
+ * @param naive_limit largest board also searched by `DynamicNQueens`
+ */
+void compare_runtime(long n, long naive_limit) {
+  std::cout << n << " queens, runtime sized..." << std::endl;
+
+  if (n <= naive_limit) {
+    report_first("in place", [n]() {
+      IncrementalBacktrack<DynamicNQueens, long> b{n};
+      b.first();
+      return b.nodes();
+    });
+  }
+
+  report_first("csp", [n]() {
+    IncrementalBacktrack<CSP<QueensConstraint>, Assignment> b{
+        queens_csp(n)};
+    b.first();
+    return b.nodes();
+  });
+}
+
+/**
+ * @brief first solution of a compile time sized board by the copying
+ * backtracker, as the baseline for `compare_runtime`
+ * @param budget time after which the search gives up
+ */
+template <long N> void naive_first(seconds budget) {
+  std::array<long, N> empty{};
+  empty.fill(UNKNOWN);
+  std::cout << N << " queens, compile time sized..." << std::endl;
+  bool timed_out = false;
+  report_first("naive", [&empty, &timed_out, budget]() {
+    Backtrack<NQueens<N>, std::array<long, N>> b{};
+    std::array<long, N> solution{};
+    b.time_limit(budget);
+    b.first(solution, empty);
+    timed_out = b.timed_out();
+    return b.nodes();
+  });
+  if (timed_out) {
+    std::cout << "  naive: gave up after " << budget.count() << "s"
+              << std::endl;
+  }
+}
+
+/**
+ * @brief first solutions of boards from N up to 32 in steps of 4, by
+ * the naive backtracker and by `compare_runtime`
+ * @param budget time the naive backtracker gets per board
+ * @param naive_limit largest board also searched by `DynamicNQueens`
+ */
+template <long N> void sweep_first(seconds budget, long naive_limit) {
+  naive_first<N>(budget);
+  compare_runtime(N, naive_limit);
+  if constexpr (N < 32) {
+    sweep_first<N + 4>(budget, naive_limit);
+  }
+}
+
+/**
+ * @brief times one solution of n queens by each Las Vegas approach
+ * @param start_count pieces randomly placed before backtracking
+ * @param backtrack_limit largest board also solved by backtracking
+ */
+void compare_las_vegas(long n, int start_count, long backtrack_limit) {
+  std::cout << n << " queens, Las Vegas..." << std::endl;
+  stopwatch<> sw;
+
+  if (n <= backtrack_limit) {
+    int attempts = find_random(n, start_count);
+    std::cout << "  random start + backtrack: " << attempts
+              << " attempts in "
+              << duration_cast<microseconds>(sw.tick()).count() << "us"
+              << std::endl;
+  }
+
+  MinConflictQueens queens{n};
+  int attempts = queens.solve();
+  if (attempts == 0) {
+    std::cout << "  min-conflicts: no solution" << std::endl;
+    return;
+  }
+  std::cout << "  min-conflicts: " << attempts << " attempts in "
+            << duration_cast<microseconds>(sw.tick()).count() << "us"
+            << (queens.valid() ? "" : " INVALID") << std::endl;
+}
+
+/**
+ * @brief counts every solution for boards from N up to `max_n`
+ * @param max_n largest board to count, at most 20
+ * @param split_depth ranks placed serially before splitting into tasks
+ * @param threads number of workers to count subtrees with
+ */
+template <long N>
+void count_boards(long max_n, long split_depth, unsigned threads) {
+  if (N > max_n) {
+    return;
+  }
+
+  stopwatch<> sw;
+  unsigned long found = BitQueens<N>::count(split_depth, threads);
+  std::cout << N << " queens: " << found << " solutions in "
+            << duration_cast<milliseconds>(sw.elapsed()).count() << "ms"
+            << std::endl;
+
+  if constexpr (N < 20) {
+    count_boards<N + 1>(max_n, split_depth, threads);
+  }
+}
 
-    best = min(best, sw.timeit(10, 10, solve_proc, (void *)&count));
+int main(int argc, char *argv[]) {
+  stopwatch<> sw;
+  timeit_options options{};
+  bool csv = false;
+  // Largest board to count all solutions for, e.g. 16-18
+  long max_n = 14;
 
+  for (int arg = 1; arg < argc; arg++) {
+    if (std::string(argv[arg]) == "--csv") {
+      csv = true;
+    } else if (std::string(argv[arg]) == "--pin" && arg + 1 < argc) {
+      options.cpu = strtol(argv[++arg], nullptr, 10);
+    } else {
+      max_n = strtol(argv[arg], nullptr, 10);
+    }
+  }
+
+  auto show = [&](const timing &t, const std::string &label) {
+    if (csv) {
+      t.csv(std::cout, label);
+    } else {
+      t.report(std::cout);
+    }
+  };
+
+  if (csv) {
+    timing::csv_header(std::cout);
+  }
+
+  double best = HUGE_VAL;
+  for (int count = 0; count < 8; count++) {
+    timing t = sw.timeit(
+        10, 10, [count]() { keep(find_random(count)); }, options);
+    best = std::min(best, t.min());
+
+    if (csv) {
+      show(t, "backtrack_8_" + std::to_string(count));
+      continue;
+    }
+    std::cout << count << " random pieces placed..." << std::endl;
+    show(t, "");
     std::cout << find_random(count)
               << " attempts before successful random initialization"
               << std::endl;
   }
 
-  std::cout << "fastest attempt took "
-            << duration_cast<std::chrono::microseconds>(best).count()
-            << " when timed." << std::endl;
+  for (int count = 0; count < 3; count++) {
+    timing t = sw.timeit(
+        10, 10,
+        [count]() {
+          BitQueens<8> b{};
+          keep(find_random<8>(b, count));
+        },
+        options);
+
+    if (!csv) {
+      std::cout << count << " random pieces placed, bitmask solver..."
+                << std::endl;
+    }
+    show(t, "bitmask_8_" + std::to_string(count));
+  }
+
+  if (csv) {
+    return 0;
+  }
+  std::cout << "fastest attempt took " << best / 1000
+            << " usec when timed." << std::endl;
+
+  for (int count = 0; count < 3; count++) {
+    compare_solvers<8>(count);
+    compare_solvers<12>(count);
+    compare_solvers<16>(count);
+    compare_solvers<20>(count);
+    compare_solvers<24>(count);
+  }
+
+  compare_in_place<8>();
+  compare_in_place<12>();
+  compare_in_place<16>();
+  compare_in_place<20>();
+
+  sweep_first<8>(seconds(30), 28);
+  std::cout << find_random(32L, 2)
+            << " attempts before successful random initialization of "
+               "32 queens"
+            << std::endl;
+
+  for (long n : {8L, 16L, 32L, 1000L, 100000L, 1000000L}) {
+    compare_las_vegas(n, 2, 32);
+  }
+
+  unsigned threads = std::thread::hardware_concurrency();
+  Backtrack<NQueens<8>, std::array<long, 8>> b{};
+  std::array<long, 8> empty{};
+  empty.fill(UNKNOWN);
+  IncrementalBacktrack<IncrementalNQueens<8>, long> in_place{};
+  std::cout << b.solutions(empty).size() << " solutions to 8 queens, "
+            << b.count(empty, 2, threads) << " counted in parallel, "
+            << in_place.count() << " counted in place" << std::endl;
+
+  count_boards<4>(max_n, 4, threads);
 }
\ No newline at end of file
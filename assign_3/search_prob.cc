@@ -1,11 +1,443 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <random>
+#include <thread>
+#include <vector>
+
+#include <immintrin.h>
+
+#include "stopwatch.hh"
 
 using namespace std;
 
 constexpr int trials = 10000;
+constexpr int INT_RADIX_BASE = 10;
+
+// Returned by the search kernels when the key is absent
+constexpr size_t NOT_FOUND = ~size_t{0};
+
+/*
+=========================================================================
+Search kernels. Each returns the index of `key` or `NOT_FOUND`
+=========================================================================
+*/
+
+/**
+ * @brief guesses random indices, like the original experiment
+ * @param probes number of guesses before giving up
+ */
+size_t random_probe(const int *arr, size_t n, int key, size_t probes,
+                    mt19937 &rng) {
+  for (size_t g = 0; g < probes; g++) {
+    size_t guess = rng() % n;
+    if (arr[guess] == key) {
+      return guess;
+    }
+  }
+  return NOT_FOUND;
+}
+
+size_t linear_scalar(const int *arr, size_t n, int key) {
+  for (size_t i = 0; i < n; i++) {
+    if (arr[i] == key) {
+      return i;
+    }
+  }
+  return NOT_FOUND;
+}
+
+/**
+ * @brief linear scan comparing 32 keys per step with AVX2
+ * @note four compares are or'd together so there is one branch per step
+ */
+__attribute__((target("avx2"))) size_t linear_avx2(const int *arr,
+                                                    size_t n, int key) {
+  const __m256i needle = _mm256_set1_epi32(key);
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    const __m256i *block = reinterpret_cast<const __m256i *>(arr + i);
+    __m256i a = _mm256_cmpeq_epi32(needle, _mm256_loadu_si256(block));
+    __m256i b = _mm256_cmpeq_epi32(needle, _mm256_loadu_si256(block + 1));
+    __m256i c = _mm256_cmpeq_epi32(needle, _mm256_loadu_si256(block + 2));
+    __m256i d = _mm256_cmpeq_epi32(needle, _mm256_loadu_si256(block + 3));
+    __m256i any =
+        _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+    if (!_mm256_testz_si256(any, any)) {
+      uint32_t mask =
+          _mm256_movemask_ps(_mm256_castsi256_ps(a)) |
+          _mm256_movemask_ps(_mm256_castsi256_ps(b)) << 8 |
+          _mm256_movemask_ps(_mm256_castsi256_ps(c)) << 16 |
+          static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(d)))
+              << 24;
+      return i + __builtin_ctz(mask);
+    }
+  }
+  size_t rest = linear_scalar(arr + i, n - i, key);
+  return rest == NOT_FOUND ? NOT_FOUND : i + rest;
+}
+
+/**
+ * @brief lower bound on a sorted array with a conditional move per level
+ */
+size_t binary_branchless(const int *sorted, size_t n, int key) {
+  const int *base = sorted;
+  size_t len = n;
+  while (len > 1) {
+    size_t half = len / 2;
+    base = (base[half - 1] < key) ? base + half : base;
+    len -= half;
+  }
+  size_t idx = base - sorted;
+  return (idx < n && sorted[idx] == key) ? idx : NOT_FOUND;
+}
+
+/**
+ * @brief lays a sorted array out in breadth-first (Eytzinger) order
+ * @note `out[0]` is unused so children of `k` are `2k` and `2k + 1`
+ */
+void eytzinger(const int *sorted, size_t n, vector<int> &out, size_t &src,
+               size_t k = 1) {
+  if (k <= n) {
+    eytzinger(sorted, n, out, src, 2 * k);
+    out[k] = sorted[src++];
+    eytzinger(sorted, n, out, src, 2 * k + 1);
+  }
+}
+
+/**
+ * @brief lower bound over an Eytzinger layout
+ * @note a whole cache line of descendants four levels down is prefetched
+ * each step, hiding memory latency on arrays beyond the caches. Near the
+ * leaves the line is past the end, so the index is clamped to `n` to
+ * keep the address inside the array
+ * @returns the Eytzinger index of `key`, or `NOT_FOUND`
+ */
+size_t eytzinger_search(const int *tree, size_t n, int key) {
+  size_t k = 1;
+  while (k <= n) {
+    __builtin_prefetch(tree + min(16 * k, n));
+    k = 2 * k + (tree[k] < key);
+  }
+  k >>= __builtin_ffsll(~k);
+  return (k != 0 && tree[k] == key) ? k : NOT_FOUND;
+}
+
+/**
+ * @brief open addressing hash index from key to array position
+ * @note linear probing in a power of two table at most half full
+ */
+class hash_index {
+  struct slot {
+    int key;
+    uint32_t pos;
+  };
+  vector<slot> slots_;
+  size_t mask_;
+
+  static constexpr uint32_t EMPTY = ~0U;
+
+  size_t home(int key) const {
+    return (static_cast<uint32_t>(key) * 0x9e3779b97f4a7c15ULL >> 32) &
+           mask_;
+  }
+
+public:
+  hash_index(const int *arr, size_t n) {
+    size_t cap = 1;
+    while (cap < 2 * n) {
+      cap <<= 1;
+    }
+    slots_.assign(cap, slot{0, EMPTY});
+    mask_ = cap - 1;
+    for (size_t i = 0; i < n; i++) {
+      size_t s = home(arr[i]);
+      while (slots_[s].pos != EMPTY) {
+        s = (s + 1) & mask_;
+      }
+      slots_[s] = {arr[i], static_cast<uint32_t>(i)};
+    }
+  }
+
+  size_t find(int key) const {
+    for (size_t s = home(key);; s = (s + 1) & mask_) {
+      if (slots_[s].pos == EMPTY) {
+        return NOT_FOUND;
+      }
+      if (slots_[s].key == key) {
+        return slots_[s].pos;
+      }
+    }
+  }
+
+  size_t bytes() const { return slots_.size() * sizeof(slot); }
+};
+
+/*
+=========================================================================
+Benchmark suite
+=========================================================================
+*/
+
+/**
+ * @brief times `search` over `queries`, checking every answer
+ * @param search callable mapping a key to the array it indexed into
+ * and the found index, as `{array, index}`
+ * @returns median nanoseconds per query
+ */
+template <typename Search>
+double ns_per_query(const vector<int> &queries, Search search) {
+  for (int key : queries) {
+    auto found = search(key);
+    if (found.second == NOT_FOUND || found.first[found.second] != key) {
+      cerr << "search failed for key " << key << endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  stopwatch<> sw;
+  timing t = sw.timeit(5, 1, [&]() {
+    size_t sum = 0;
+    for (int key : queries) {
+      sum += search(key).second;
+    }
+    keep(sum);
+  });
+  return t.median() / queries.size();
+}
+
+/**
+ * @brief compares search kernels for array sizes from L1 to past LLC
+ * @param max_size largest array searched, in elements
+ * @param linear_max largest array searched by scanning or probing
+ */
+void bench(size_t max_size, size_t linear_max) {
+  mt19937 rng(1234U);
+  const bool avx2 = __builtin_cpu_supports("avx2");
+
+  cout << "method,size,bytes,ns_per_query" << endl;
+  for (size_t n = 1024; n <= max_size; n *= 4) {
+    // distinct sorted keys with random gaps
+    vector<int> sorted(n);
+    int key = 0;
+    for (int &k : sorted) {
+      k = key += 1 + rng() % 4;
+    }
+    vector<int> shuffled(sorted);
+    shuffle(shuffled.begin(), shuffled.end(), rng);
+    vector<int> tree(n + 1);
+    size_t src = 0;
+    eytzinger(sorted.data(), n, tree, src);
+    hash_index index(shuffled.data(), n);
+
+    // Fewer queries for the kernels costing O(n) each
+    auto queries = [&](size_t count) {
+      vector<int> q(count);
+      for (int &k : q) {
+        k = sorted[rng() % n];
+      }
+      return q;
+    };
+    vector<int> many = queries(1 << 16);
+    vector<int> few = queries(max<size_t>(64, (1 << 24) / n));
+
+    auto row = [&](const char *method, size_t bytes, double ns) {
+      cout << method << "," << n << "," << bytes << "," << ns << endl;
+    };
+    const size_t bytes = n * sizeof(int);
+    const int *arr = shuffled.data();
+
+    if (n <= linear_max) {
+      mt19937 probe_rng(rng());
+      row("random_probe", bytes, ns_per_query(few, [&](int k) {
+            return make_pair(arr, random_probe(arr, n, k, 50 * n,
+                                               probe_rng));
+          }));
+      row("linear_scalar", bytes, ns_per_query(few, [&](int k) {
+            return make_pair(arr, linear_scalar(arr, n, k));
+          }));
+      if (avx2) {
+        row("linear_avx2", bytes, ns_per_query(few, [&](int k) {
+              return make_pair(arr, linear_avx2(arr, n, k));
+            }));
+      }
+    }
+    row("binary_branchless", bytes, ns_per_query(many, [&](int k) {
+          return make_pair(sorted.data(),
+                           binary_branchless(sorted.data(), n, k));
+        }));
+    row("eytzinger", bytes, ns_per_query(many, [&](int k) {
+          return make_pair(tree.data(), eytzinger_search(tree.data(), n, k));
+        }));
+    row("hash", bytes + index.bytes(), ns_per_query(many, [&](int k) {
+          return make_pair(arr, index.find(k));
+        }));
+  }
+}
+
+/*
+=========================================================================
+Parallel random guessing trials
+=========================================================================
+*/
+
+/**
+ * @brief xoshiro256** generator, seeded through splitmix64
+ * @note small, fast and independent per thread, unlike the global `rand()`
+ */
+class xoshiro256 {
+  uint64_t s[4];
+
+  static uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+
+public:
+  explicit xoshiro256(uint64_t seed) {
+    for (uint64_t &word : s) {
+      uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      word = z ^ (z >> 31);
+    }
+  }
+
+  uint64_t operator()() {
+    const uint64_t result = rotl(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+  }
+
+  /**
+   * @brief fills `out` with `count` indices below `n`
+   * @note two indices per 64-bit draw, each mapped into range with a
+   * multiply and shift instead of a division
+   */
+  void indices(uint32_t *out, size_t count, uint32_t n) {
+    for (size_t i = 0; i < count; i += 2) {
+      uint64_t r = (*this)();
+      out[i] = (r & 0xffffffffULL) * n >> 32;
+      out[i + 1] = (r >> 32) * n >> 32;
+    }
+  }
+};
+
+/** @brief settings of a run of random guessing trials */
+struct trial_config {
+  uint64_t trials = ::trials;
+  uint32_t size = 1000;
+  uint64_t probes = 5000;
+  unsigned threads = std::max(1U, thread::hardware_concurrency());
+  uint64_t seed = 1234U;
+};
+
+/** @brief totals of a run of random guessing trials */
+struct trial_counts {
+  uint64_t successful = 0;
+  uint64_t comparisons = 0;
+};
+
+// Trials seeded together. Blocks are claimed by whichever thread is
+// free, so totals do not depend on the number of threads.
+constexpr uint64_t TRIAL_BLOCK = 1024;
+
+// Guess indices drawn at a time
+constexpr size_t PROBE_BATCH = 64;
+
+/**
+ * @brief runs one block of trials from its own seeded generator
+ */
+void trial_block(const trial_config &config, uint64_t block,
+                 vector<uint32_t> &arr, trial_counts &counts) {
+  xoshiro256 rng(config.seed ^ (block * 0xd1342543de82ef95ULL));
+  uint64_t end = min(config.trials, (block + 1) * TRIAL_BLOCK);
+  uint32_t guesses[PROBE_BATCH];
+
+  for (uint64_t t = block * TRIAL_BLOCK; t < end; t++) {
+    for (size_t i = 0; i + 1 < arr.size(); i += 2) {
+      uint64_t r = rng();
+      arr[i] = static_cast<uint32_t>(r);
+      arr[i + 1] = static_cast<uint32_t>(r >> 32);
+    }
+    // pairs above fill every slot of an even sized array
+    if (arr.size() % 2 == 1) {
+      arr.back() = static_cast<uint32_t>(rng());
+    }
 
-auto main(int /*argc*/, char * /*argv*/ []) -> int {
+    rng.indices(guesses, 2, config.size);
+    uint32_t s = arr[guesses[0]];
+
+    for (uint64_t g = 0; g < config.probes;) {
+      rng.indices(guesses, PROBE_BATCH, config.size);
+      size_t batch = min<uint64_t>(PROBE_BATCH, config.probes - g);
+      size_t hit = batch;
+      for (size_t b = 0; b < batch; b++) {
+        if (arr[guesses[b]] == s) {
+          hit = b;
+          break;
+        }
+      }
+      if (hit < batch) {
+        counts.comparisons += hit + 1;
+        counts.successful++;
+        break;
+      }
+      counts.comparisons += batch;
+      g += batch;
+    }
+  }
+}
+
+/**
+ * @brief random guessing trials spread across threads
+ * @returns total successes and comparisons over every trial
+ */
+trial_counts parallel_trials(const trial_config &config) {
+  struct alignas(64) slot {
+    trial_counts counts;
+  };
+  vector<slot> slots(config.threads);
+  atomic<uint64_t> next{0};
+  const uint64_t blocks = (config.trials + TRIAL_BLOCK - 1) / TRIAL_BLOCK;
+
+  auto worker = [&](unsigned id) {
+    vector<uint32_t> arr(config.size);
+    uint64_t block;
+    while ((block = next.fetch_add(1)) < blocks) {
+      trial_block(config, block, arr, slots[id].counts);
+    }
+  };
+
+  vector<thread> pool;
+  for (unsigned id = 1; id < config.threads; id++) {
+    pool.emplace_back(worker, id);
+  }
+  worker(0);
+  for (auto &t : pool) {
+    t.join();
+  }
+
+  trial_counts total{};
+  for (auto &slot : slots) {
+    total.successful += slot.counts.successful;
+    total.comparisons += slot.counts.comparisons;
+  }
+  return total;
+}
+
+/**
+ * @brief original experiment: comparisons for random guessing
+ */
+void random_probe_trials() {
   srand(time(nullptr));
   int arr[1000];
   int successful = 0;
@@ -31,3 +463,58 @@ auto main(int /*argc*/, char * /*argv*/ []) -> int {
        << comparisons / float(successful)
        << " comparisons on average when successful" << endl;
 }
+
+auto main(int argc, char *argv[]) -> int {
+  if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+    size_t max_size = 1 << 24;
+    if (argc > 2) {
+      max_size = strtoull(argv[2], nullptr, INT_RADIX_BASE);
+    }
+    bench(max_size, 1 << 16);
+    return 0;
+  }
+
+  if (argc > 1 && strcmp(argv[1], "--serial") == 0) {
+    random_probe_trials();
+    return 0;
+  }
+
+  if (argc > 1 && argv[1][0] == '-') {
+    cerr << "Usage: " << argv[0]
+         << " [trials [size [probes [threads [seed]]]]]" << endl;
+    cerr << "       " << argv[0] << " --serial" << endl;
+    cerr << "       " << argv[0] << " --bench [max_size]" << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  trial_config config{};
+  uint64_t *fields[] = {&config.trials, nullptr, &config.probes, nullptr,
+                        &config.seed};
+  for (int arg = 1; arg < argc && arg <= 5; arg++) {
+    uint64_t value = strtoull(argv[arg], nullptr, INT_RADIX_BASE);
+    if (arg == 2) {
+      config.size = static_cast<uint32_t>(max<uint64_t>(2, value));
+    } else if (arg == 4) {
+      config.threads = static_cast<unsigned>(max<uint64_t>(1, value));
+    } else {
+      *fields[arg - 1] = value;
+    }
+  }
+  if (config.trials < 1) {
+    cerr << "trials must be at least 1" << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  auto start = chrono::steady_clock::now();
+  trial_counts counts = parallel_trials(config);
+  chrono::duration<double> time = chrono::steady_clock::now() - start;
+
+  cout << "Affter " << config.trials << " trials of " << config.size
+       << " numbers, " << counts.successful
+       << " were successful. searching takes "
+       << counts.comparisons / double(counts.successful)
+       << " comparisons on average when successful" << endl;
+  cout << config.threads << " threads ran "
+       << static_cast<uint64_t>(config.trials / time.count())
+       << " trials/sec in " << time.count() << "s" << endl;
+}
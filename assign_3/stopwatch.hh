@@ -0,0 +1,227 @@
+#ifndef STOPWATCH_HH
+#define STOPWATCH_HH
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+/*
+=========================================================================
+Timing harness shared by the assign_3 experiments
+=========================================================================
+*/
+
+/**
+ * @brief keeps the compiler from optimizing away a benchmarked value
+ * @param value the result to treat as observed
+ */
+template <typename T> inline void keep(T const &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/** @brief settings for `stopwatch<>::timeit` */
+struct timeit_options {
+  // untimed trials run first to warm caches and branch predictors
+  long warmup = 1;
+  // core to pin the timing thread to while measuring, -1 to not pin
+  int cpu = -1;
+  // subtract the cost of timing an empty loop from every trial
+  bool calibrate = true;
+};
+
+/**
+ * @brief trial times of one `timeit` run and their summary statistics
+ * @note samples are nanoseconds per loop, sorted ascending
+ */
+struct timing {
+  long trials = 0;
+  long loops = 0;
+  double overhead = 0;
+  std::vector<double> samples{};
+
+  /**
+   * @brief interpolated percentile of the samples
+   * @param p percentile in [0, 100]
+   */
+  double percentile(double p) const {
+    if (samples.empty()) {
+      return 0;
+    }
+    double rank = p / 100.0 * (samples.size() - 1);
+    size_t lo = static_cast<size_t>(rank);
+    size_t hi = std::min(lo + 1, samples.size() - 1);
+    return samples[lo] + (rank - lo) * (samples[hi] - samples[lo]);
+  }
+
+  double min() const { return percentile(0); }
+  double median() const { return percentile(50); }
+  double max() const { return percentile(100); }
+
+  /** @brief median absolute deviation from the median */
+  double mad() const {
+    std::vector<double> deviations{};
+    double mid = median();
+    for (double sample : samples) {
+      deviations.push_back(std::abs(sample - mid));
+    }
+    std::sort(deviations.begin(), deviations.end());
+    timing spread{};
+    spread.samples = deviations;
+    return spread.median();
+  }
+
+  /** @brief human readable summary, similar to python3 -m timeit */
+  void report(std::ostream &out) const {
+    out << loops << " loops, best of " << trials << " trials: " << min()
+        << " nsec per loop (median " << median() << ", MAD " << mad()
+        << ", p90 " << percentile(90) << ", p99 " << percentile(99)
+        << ")" << std::endl;
+  }
+
+  /** @brief column names matching `csv` rows */
+  static void csv_header(std::ostream &out) {
+    out << "label,trials,loops,overhead_ns,min_ns,median_ns,mad_ns,"
+           "p90_ns,p99_ns,max_ns"
+        << std::endl;
+  }
+
+  /** @brief machine readable summary as one CSV row */
+  void csv(std::ostream &out, const std::string &label) const {
+    out << label << "," << trials << "," << loops << "," << overhead
+        << "," << min() << "," << median() << "," << mad() << ","
+        << percentile(90) << "," << percentile(99) << "," << max()
+        << std::endl;
+  }
+};
+
+/**
+ * @brief pins the calling thread to one core for its lifetime
+ * @note does nothing for negative cores or outside of Linux
+ */
+class cpu_pin {
+#ifdef __linux__
+  cpu_set_t saved_{};
+  bool pinned_ = false;
+#endif
+
+public:
+  explicit cpu_pin(int cpu) {
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE ||
+        sched_getaffinity(0, sizeof(saved_), &saved_) != 0) {
+      return;
+    }
+    cpu_set_t one;
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    pinned_ = sched_setaffinity(0, sizeof(one), &one) == 0;
+#else
+    (void)cpu;
+#endif
+  }
+
+  ~cpu_pin() {
+#ifdef __linux__
+    if (pinned_) {
+      sched_setaffinity(0, sizeof(saved_), &saved_);
+    }
+#endif
+  }
+
+  cpu_pin(const cpu_pin &) = delete;
+  cpu_pin &operator=(const cpu_pin &) = delete;
+};
+
+/**
+ * @brief Stopwatch with timer for process functions
+ * @tparam Clock the system clock to use for timing resolutions
+ */
+template <typename Clock = std::chrono::steady_clock> class stopwatch {
+  typename Clock::time_point last_;
+
+  /** @brief nanoseconds per loop of each trial of `proc` */
+  template <typename Proc>
+  std::vector<double> trial_times(long trials, long loops, Proc &proc) {
+    std::vector<double> samples{};
+    for (long trial = 0; trial < trials; trial++) {
+      reset();
+
+      // repeatedly run proc. ignore result for timing
+      for (long loop = 0; loop < loops; loop++) {
+        proc();
+      }
+
+      samples.push_back(
+          std::chrono::duration<double, std::nano>(tick()).count() /
+          loops);
+    }
+    return samples;
+  }
+
+public:
+  stopwatch() : last_(Clock::now()) {}
+
+  /** @brief resets the stopwatch */
+  void reset() { last_ = Clock::now(); }
+
+  /**
+   * @brief gives elapsed duration since last reset or construction
+   * @returns stopwatch time elapsed as `Clock::duration`
+   */
+  typename Clock::duration elapsed() const {
+    return Clock::now() - last_;
+  }
+
+  /**
+   * @brief returns elapsed time and resets stopwatch
+   * @returns elapsed stopwatch time of tick
+   */
+  typename Clock::duration tick() {
+    auto now = Clock::now();
+    auto elapsed = now - last_;
+    last_ = now;
+    return elapsed;
+  }
+
+  /**
+   * @brief runs trials of processes. similar to python3 -m timeit module
+   * @param trials How many trials to run the repeated process
+   * @param loops number of looped repitions per time trial
+   * @param proc callable with no arguments to run in a trial
+   * @param options warm-up, core pinning and overhead calibration
+   * @returns per loop times of every trial, see `timing`
+   */
+  template <typename Proc>
+  timing timeit(long trials, long loops, Proc &&proc,
+                timeit_options options = {}) {
+    cpu_pin pin(options.cpu);
+
+    timing result{};
+    result.trials = trials;
+    result.loops = loops;
+
+    if (options.calibrate && trials > 0) {
+      auto empty = []() { keep(0); };
+      auto idle = trial_times(trials, loops, empty);
+      std::sort(idle.begin(), idle.end());
+      result.overhead = idle[idle.size() / 2];
+    }
+
+    trial_times(options.warmup, loops, proc);
+    result.samples = trial_times(trials, loops, proc);
+    for (double &sample : result.samples) {
+      sample = std::max(0.0, sample - result.overhead);
+    }
+    std::sort(result.samples.begin(), result.samples.end());
+    return result;
+  }
+};
+
+#endif
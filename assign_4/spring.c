@@ -1,63 +1,338 @@
+#define _GNU_SOURCE /* vmsplice and F_SETPIPE_SZ */
+
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "spring.h"
 
-typedef __uint128_t uint128_t;
-typedef __uint64_t uint64_t;
-typedef __uint8_t uint8_t;
+double now_seconds(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
 
-uint8_t ascii2hex(char s) {
-  uint8_t r = 0xf;
+/*
+ * Checks the table engine against `spring_prng` bit for bit, then reports the
+ * throughput of both and of `spring_fill` into a 1MiB buffer.
+ */
+int speed(Spring *gen) {
+  const size_t check_words = 1 << 16;
+  const size_t fast_words = 1 << 24;
+  const size_t fill_bytes = 1 << 20;
+  const int fills = 256;
+  spring_uint128 slow[6];
+  SpringEngine engine = gen->engine;
+  uint8_t out[16];
 
-  if ((s >= 48) && (s <= 57)) {
-    r = s - 48;
-  } else if ((s >= 65) && (s <= 70)) {
-    r = s - 55;
-  } else if ((s >= 97) && (s <= 102)) {
-    r = s - 87;
+  memcpy(slow, gen->start, sizeof(slow));
+  for (size_t word = 0; word < check_words; word++) {
+    spring_uint128 cw = spring_prng(slow);
+    spring_prng_fast(&engine, out);
+    for (int byte = 0; byte < 16; byte++) {
+      if (out[byte] != (uint8_t)(cw >> (byte * 8))) {
+        fprintf(stderr, "mismatch in codeword %zu byte %d\n", word, byte);
+        return EXIT_FAILURE;
+      }
+    }
   }
-  return r;
+  fprintf(stderr, "%zu codewords match the bitwise generator\n",
+          check_words);
+
+  /* volatile sinks keep the timed loops from being optimized away */
+  memcpy(slow, gen->start, sizeof(slow));
+  volatile spring_uint128 sink = 0;
+  double start = now_seconds();
+  for (size_t word = 0; word < check_words; word++) {
+    sink ^= spring_prng(slow);
+  }
+  double bitwise = now_seconds() - start;
+
+  volatile uint8_t fold = 0;
+  start = now_seconds();
+  for (size_t word = 0; word < fast_words; word++) {
+    spring_prng_fast(&engine, out);
+    fold ^= out[word & 15];
+  }
+  double table = now_seconds() - start;
+
+  uint8_t *buf = malloc(fill_bytes);
+  if (buf == NULL) {
+    perror("malloc");
+    return EXIT_FAILURE;
+  }
+  start = now_seconds();
+  for (int round = 0; round < fills; round++) {
+    spring_fill(gen, buf, fill_bytes);
+    fold ^= buf[round];
+  }
+  double filled = now_seconds() - start;
+  free(buf);
+
+  fprintf(stderr, "bitwise: %.4f GB/s\n",
+          check_words * 16 / bitwise / 1e9);
+  fprintf(stderr, "table:   %.4f GB/s\n", fast_words * 16 / table / 1e9);
+  fprintf(stderr, "fill:    %.4f GB/s\n",
+          (double)fill_bytes * fills / filled / 1e9);
+  return EXIT_SUCCESS;
 }
 
-uint128_t hex_strtoulll(const char *nptr, int len) {
-  int i;
-  uint128_t r = 0;
-  uint128_t p;
+/* === Bulk output === */
+
+/* Bytes per output buffer. A multiple of 16 and of the page size. */
+#define BUFFER_SIZE (1 << 20)
 
-  for (i = len; i >= 0; i--) {
-    p = (uint128_t)ascii2hex(*(nptr + i));
-    p = p << ((len - i) << 2);
-    r |= p;
+/* Bytes between throughput reports with --bench */
+#define REPORT_BYTES (1ULL << 30)
+
+void fill(SpringEngine *engine, uint8_t *buf, size_t len) {
+  for (size_t off = 0; off < len; off += 16) {
+    spring_prng_fast(engine, buf + off);
   }
-  return r;
 }
 
-uint128_t glfsr(uint128_t mask, uint128_t *lfsr) {
-  uint128_t lsb = (*lfsr) & 1U; /* Get LSB (i.e., the output bit). */
-  *lfsr >>= 1;                  /* Shift register */
-  if (lsb) {                    /* If the output bit is 1, */
-    *lfsr ^= mask;              /*  apply toggle mask. */
+/* Writes all of `buf`, returning 0, or -1 once the reader is gone. */
+int write_all(int fd, const uint8_t *buf, size_t len) {
+  while (len > 0) {
+    ssize_t done = write(fd, buf, len);
+    if (done < 0 && errno == EINTR) {
+      continue;
+    }
+    if (done <= 0) {
+      return -1;
+    }
+    buf += done;
+    len -= (size_t)done;
   }
-  return lsb;
+  return 0;
 }
 
-uint128_t prng(uint128_t *params) {
-  uint128_t codeword = 0;
-  uint128_t control = glfsr(params[0], &params[1]);
-  for (int pos = 0; pos < 128; pos++) {
-    codeword <<= 1;
-    codeword |= glfsr(params[2 | control], &params[4 | control]);
+#ifdef __linux__
+/*
+ * Gives the pages of `buf` to the pipe instead of copying them, so the
+ * buffer must not change until the reader has consumed it. Returns 0,
+ * 1 if vmsplice is unsupported, or -1 once the reader is gone.
+ */
+int splice_all(int fd, uint8_t *buf, size_t len) {
+  while (len > 0) {
+    struct iovec iov = {buf, len};
+    ssize_t done = vmsplice(fd, &iov, 1, 0);
+    if (done < 0 && errno == EINTR) {
+      continue;
+    }
+    if (done < 0 && (errno == EINVAL || errno == ENOSYS)) {
+      return 1;
+    }
+    if (done <= 0) {
+      return -1;
+    }
+    buf += done;
+    len -= (size_t)done;
+  }
+  return 0;
+}
+#endif
+
+void report(unsigned long long bytes, double start, const char *when) {
+  double elapsed = now_seconds() - start;
+  fprintf(stderr, "%s%llu bytes in %.3fs: %.1f MB/s\n", when, bytes,
+          elapsed, bytes / elapsed / 1e6);
+}
+
+/* Rounds of buffers in flight: generating, writing, draining */
+#define ROUNDS 3
+
+/* One buffer of output, generated by its own thread. */
+typedef struct block_ {
+  SpringEngine engine;
+  uint8_t *buf;
+  size_t len;
+  pthread_t thread;
+} Block;
+
+void *fill_block(void *arg) {
+  Block *block = arg;
+  /* a partial codeword at the end is generated whole and cut off */
+  fill(&block->engine, block->buf, (block->len + 15) & ~(size_t)15);
+  return NULL;
+}
+
+/* Writes a buffer, returning 0 or -1 once the reader is gone. */
+int emit(uint8_t *buf, size_t len, int *use_splice) {
+#ifdef __linux__
+  if (*use_splice) {
+    int status = splice_all(STDOUT_FILENO, buf, len);
+    if (status != 1) {
+      return status;
+    }
+    *use_splice = 0;
   }
-  return codeword;
+#else
+  (void)use_splice;
+#endif
+  return write_all(STDOUT_FILENO, buf, len);
+}
+
+/*
+ * Streams the keystream to stdout in large aligned buffers, through
+ * vmsplice when stdout is a pipe. Each round, `threads` consecutive
+ * buffers are generated in parallel from engines skipped ahead to their
+ * offsets, while the previous round is written out in order. The output
+ * is the same for any number of threads. A round is refilled only after
+ * the round following it has been written, so a pipe holding at most one
+ * buffer has been drained of spliced pages before they are reused.
+ * limit: bytes to write, 0 for an endless stream.
+ * bench: report sustained throughput to stderr.
+ */
+int stream(SpringEngine *engine, unsigned long long limit, int bench,
+           int threads) {
+  Block *rounds[ROUNDS];
+  for (int r = 0; r < ROUNDS; r++) {
+    rounds[r] = calloc((size_t)threads, sizeof(Block));
+    for (int t = 0; rounds[r] != NULL && t < threads; t++) {
+      rounds[r][t].buf = aligned_alloc(4096, BUFFER_SIZE);
+      if (rounds[r][t].buf == NULL) {
+        rounds[r] = NULL;
+      }
+    }
+    if (rounds[r] == NULL) {
+      perror("alloc");
+      return EXIT_FAILURE;
+    }
+  }
+
+  /* a closed reader ends the stream rather than killing the process */
+  signal(SIGPIPE, SIG_IGN);
+
+  int use_splice = 0;
+#ifdef __linux__
+  struct stat st;
+  if (fstat(STDOUT_FILENO, &st) == 0 && S_ISFIFO(st.st_mode)) {
+    use_splice =
+        fcntl(STDOUT_FILENO, F_SETPIPE_SZ, BUFFER_SIZE) == BUFFER_SIZE;
+  }
+#endif
+
+  unsigned long long generated = 0;
+  unsigned long long written = 0;
+  unsigned long long next_report = REPORT_BYTES;
+  double start = now_seconds();
+  int status = 0;
+  int pending = 0; /* blocks of the previous round still to write */
+
+  for (int turn = 0; status == 0; turn = (turn + 1) % ROUNDS) {
+    Block *round = rounds[turn];
+    int count = 0;
+    for (; count < threads && (limit == 0 || generated < limit);
+         count++) {
+      Block *block = &round[count];
+      block->len = BUFFER_SIZE;
+      if (limit != 0 && limit - generated < block->len) {
+        block->len = (size_t)(limit - generated);
+      }
+      block->engine = *engine;
+      spring_engine_skip(engine, BUFFER_SIZE / 16);
+      generated += block->len;
+      pthread_create(&block->thread, NULL, fill_block, block);
+    }
+
+    Block *previous = rounds[(turn + ROUNDS - 1) % ROUNDS];
+    for (int b = 0; b < pending && status == 0; b++) {
+      status = emit(previous[b].buf, previous[b].len, &use_splice);
+      if (status == 0) {
+        written += previous[b].len;
+      }
+      if (bench && written >= next_report) {
+        report(written, start, "");
+        next_report += REPORT_BYTES;
+      }
+    }
+
+    for (int b = 0; b < count; b++) {
+      pthread_join(round[b].thread, NULL);
+    }
+    pending = count;
+    if (pending == 0) {
+      break;
+    }
+  }
+
+  if (bench) {
+    report(written, start, "total: ");
+  }
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int t = 0; t < threads; t++) {
+      free(rounds[r][t].buf);
+    }
+    free(rounds[r]);
+  }
+  return EXIT_SUCCESS;
 }
 
 int main(int argc, char *argv[]) {
-  if (argc < 7) {
+  int arg = 1;
+  int speed_only = 0;
+  int selftest = 0;
+  int bench = 0;
+  int threads = 1;
+  unsigned long long limit = 0;
+  unsigned long long seek = 0;
+  for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+    if (strcmp(argv[arg], "--speed") == 0) {
+      speed_only = 1;
+    } else if (strcmp(argv[arg], "--selftest") == 0) {
+      selftest = 1;
+    } else if (strcmp(argv[arg], "--bench") == 0) {
+      bench = 1;
+    } else if (strcmp(argv[arg], "--bytes") == 0 && arg + 1 < argc) {
+      char *end;
+      limit = strtoull(argv[++arg], &end, 10);
+      if (*end != '\0' || limit == 0) {
+        fprintf(stderr, "%s is not a positive byte count\n", argv[arg]);
+        exit(EXIT_FAILURE);
+      }
+    } else if (strcmp(argv[arg], "--seek") == 0 && arg + 1 < argc) {
+      char *end;
+      seek = strtoull(argv[++arg], &end, 10);
+      if (*end != '\0') {
+        fprintf(stderr, "%s is not a byte offset\n", argv[arg]);
+        exit(EXIT_FAILURE);
+      }
+    } else if (strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc) {
+      threads = atoi(argv[++arg]);
+      if (threads < 1) {
+        fprintf(stderr, "%s is not a thread count\n", argv[arg]);
+        exit(EXIT_FAILURE);
+      }
+    } else {
+      arg = argc;
+    }
+  }
+
+  if (selftest) {
+    int failed = spring_selftest();
+    if (failed != 0) {
+      fprintf(stderr, "known answer test %d failed\n", failed);
+      return EXIT_FAILURE;
+    }
+    fprintf(stderr, "known answer tests passed\n");
+    return EXIT_SUCCESS;
+  }
+
+  if (argc - arg < 6) {
     fprintf(stderr,
-            "usage: %s "
+            "usage: %s [--selftest] [--speed] [--bench] [--bytes n] "
+            "[--seek offset] [--threads n] "
             "control_poly control_start "
             "data1_poly data2_poly "
             "data1_start data2_start \n",
@@ -65,14 +340,40 @@ int main(int argc, char *argv[]) {
     exit(EXIT_FAILURE);
   }
 
-  uint128_t params[6];
+  spring_uint128 params[6];
   for (int i = 0; i < 6; i++) {
-    params[i] = hex_strtoulll(argv[i + 1], strlen(argv[i + 1]) - 1);
+    if (spring_parse_hex(argv[arg + i], &params[i]) != SPRING_OK) {
+      fprintf(stderr, "%s: %s\n", argv[arg + i],
+              spring_strerror(SPRING_BAD_HEX));
+      exit(EXIT_FAILURE);
+    }
   }
-  for (;;) {
-    uint128_t cw = prng(params);
-    for (uint128_t shift = 0; shift < 128; shift += 8) {
-      printf("%c", (char)((cw >> shift) & 0xffLU));
+
+  static Spring gen;
+  SpringStatus status = spring_init(&gen, params);
+  if (status != SPRING_OK) {
+    fprintf(stderr, "invalid parameters: %s\n", spring_strerror(status));
+    exit(EXIT_FAILURE);
+  }
+  if (speed_only) {
+    return speed(&gen);
+  }
+
+  /* an offset inside a codeword drops the start of that codeword */
+  spring_seek(&gen, seek);
+  uint8_t head[16];
+  size_t len = gen.head_len;
+  if (len > 0) {
+    if (limit != 0 && limit < len) {
+      len = (size_t)limit;
+    }
+    spring_fill(&gen, head, len);
+    if (write_all(STDOUT_FILENO, head, len) != 0) {
+      return EXIT_SUCCESS;
+    }
+    if (limit != 0 && (limit -= len) == 0) {
+      return EXIT_SUCCESS;
     }
   }
-}
\ No newline at end of file
+  return stream(&gen.engine, limit, bench, threads);
+}
@@ -0,0 +1,485 @@
+#ifndef SPRING_H
+#define SPRING_H
+
+/*
+ * Header only library for the spring keystream generator: a 128-bit
+ * control LFSR picks which of two 128-bit data LFSRs produces each 128-bit
+ * codeword. Include it from C or C++ and embed the keystream directly:
+ *
+ *   static Spring gen;
+ *   if (spring_init(&gen, params) != SPRING_OK) ...
+ *   spring_fill(&gen, buf, n);
+ *
+ * params are control_poly control_start data1_poly data2_poly data1_start
+ * data2_start, the same order as the spring command line.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef __uint128_t spring_uint128;
+
+/* === Bitwise reference generator === */
+
+static inline spring_uint128 spring_glfsr(spring_uint128 mask,
+                                          spring_uint128 *lfsr) {
+  spring_uint128 lsb = (*lfsr) & 1U; /* Get LSB (i.e., the output bit). */
+  *lfsr >>= 1;                       /* Shift register */
+  if (lsb) {                         /* If the output bit is 1, */
+    *lfsr ^= mask;                   /*  apply toggle mask. */
+  }
+  return lsb;
+}
+
+static inline spring_uint128 spring_prng(spring_uint128 *params) {
+  spring_uint128 codeword = 0;
+  spring_uint128 control = spring_glfsr(params[0], &params[1]);
+  for (int pos = 0; pos < 128; pos++) {
+    codeword <<= 1;
+    codeword |= spring_glfsr(params[2 | control], &params[4 | control]);
+  }
+  return codeword;
+}
+
+/* === Table driven engine === */
+
+/*
+ * A Galois LFSR step is linear over GF(2), so 32 steps from any state are
+ * the 32 steps from its low 32 bits xor'd onto the state shifted down 32.
+ * The high bits only shift during those steps since the low bits alone
+ * decide which steps toggle. By linearity again the low 32 bits split
+ * into four bytes, each with a 256 entry table of the toggle pattern and
+ * the 32 output bits it contributes. The four lookups are independent, so
+ * a codeword is 4 dependent steps instead of 128.
+ */
+#define SPRING_TABLE_BYTES 4
+#define SPRING_TABLE_STEPS (8 * SPRING_TABLE_BYTES)
+
+typedef struct spring_lfsr_table_ {
+  spring_uint128 toggle[SPRING_TABLE_BYTES][256];
+  uint32_t bits[SPRING_TABLE_BYTES][256]; /* first emitted bit in the MSB */
+} SpringLfsrTable;
+
+typedef struct spring_tables_ {
+  SpringLfsrTable data[2];
+  SpringLfsrTable control;
+} SpringTables;
+
+/* Generator state. Copies share the read-only tables. */
+typedef struct spring_engine_ {
+  spring_uint128 params[6];
+  const SpringTables *tables;
+} SpringEngine;
+
+static inline void spring_build_table(SpringLfsrTable *table,
+                                      spring_uint128 mask) {
+  for (int part = 0; part < SPRING_TABLE_BYTES; part++) {
+    for (int b = 0; b < 256; b++) {
+      spring_uint128 lfsr = (spring_uint128)b << (8 * part);
+      uint32_t bits = 0;
+      for (int step = 0; step < SPRING_TABLE_STEPS; step++) {
+        bits = (bits << 1) | (uint32_t)spring_glfsr(mask, &lfsr);
+      }
+      table->toggle[part][b] = lfsr;
+      table->bits[part][b] = bits;
+    }
+  }
+}
+
+static inline void spring_engine_init(SpringEngine *engine,
+                                      SpringTables *tables,
+                                      const spring_uint128 *params) {
+  spring_build_table(&tables->data[0], params[2]);
+  spring_build_table(&tables->data[1], params[3]);
+  spring_build_table(&tables->control, params[0]);
+  memcpy(engine->params, params, sizeof(engine->params));
+  engine->tables = tables;
+}
+
+/* Advances `lfsr` 32 steps, returning its output bits MSB first. */
+static inline uint32_t spring_glfsr32(const SpringLfsrTable *table,
+                                      spring_uint128 *lfsr) {
+  uint32_t low = (uint32_t)*lfsr;
+  uint8_t b0 = (uint8_t)low;
+  uint8_t b1 = (uint8_t)(low >> 8);
+  uint8_t b2 = (uint8_t)(low >> 16);
+  uint8_t b3 = (uint8_t)(low >> 24);
+  *lfsr = (*lfsr >> SPRING_TABLE_STEPS) ^ table->toggle[0][b0] ^
+          table->toggle[1][b1] ^ table->toggle[2][b2] ^
+          table->toggle[3][b3];
+  return table->bits[0][b0] ^ table->bits[1][b1] ^ table->bits[2][b2] ^
+         table->bits[3][b3];
+}
+
+/*
+ * Same codeword as `spring_prng`, written as the 16 bytes of the
+ * keystream: least significant byte first, i.e. the last 8 bits
+ * generated come first.
+ */
+static inline void spring_prng_fast(SpringEngine *engine, uint8_t out[16]) {
+  spring_uint128 control = spring_glfsr(engine->params[0], &engine->params[1]);
+  const SpringLfsrTable *table = &engine->tables->data[control];
+  spring_uint128 *lfsr = &engine->params[4 | control];
+  for (int byte = 15; byte > 0; byte -= 4) {
+    uint32_t bits = spring_glfsr32(table, lfsr);
+    out[byte] = (uint8_t)(bits >> 24);
+    out[byte - 1] = (uint8_t)(bits >> 16);
+    out[byte - 2] = (uint8_t)(bits >> 8);
+    out[byte - 3] = (uint8_t)bits;
+  }
+}
+
+/* === Jump ahead === */
+
+/*
+ * The step map A of a 128-bit Galois LFSR with toggle mask m has the
+ * characteristic polynomial c(x) = x^128 + sum of m_j x^(127 - j), so by
+ * Cayley-Hamilton A^k = r(A) for r(x) = x^k mod c(x). Polynomials of
+ * degree below 128 are kept in a spring_uint128, x^i in bit i, and c(x) by
+ * its low 128 coefficients.
+ */
+static inline spring_uint128 spring_charpoly_low(spring_uint128 mask) {
+  spring_uint128 low = 0;
+  for (int j = 0; j < 128; j++) {
+    low |= ((mask >> j) & 1U) << (127 - j);
+  }
+  return low;
+}
+
+/* r(x) * x mod c(x) */
+static inline spring_uint128 spring_poly_mulx(spring_uint128 r,
+                                              spring_uint128 low) {
+  spring_uint128 carry = r >> 127;
+  r <<= 1;
+  return carry ? r ^ low : r;
+}
+
+/* a(x) * b(x) mod c(x) */
+static inline spring_uint128 spring_poly_mulmod(spring_uint128 a,
+                                                spring_uint128 b,
+                                                spring_uint128 low) {
+  spring_uint128 r = 0;
+  for (int i = 127; i >= 0; i--) {
+    r = spring_poly_mulx(r, low);
+    if ((b >> i) & 1U) {
+      r ^= a;
+    }
+  }
+  return r;
+}
+
+/* x^k mod c(x) by left to right square and multiply */
+static inline spring_uint128 spring_poly_xpow(spring_uint128 k,
+                                              spring_uint128 low) {
+  spring_uint128 r = 1;
+  for (int i = 127; i >= 0; i--) {
+    r = spring_poly_mulmod(r, r, low);
+    if ((k >> i) & 1U) {
+      r = spring_poly_mulx(r, low);
+    }
+  }
+  return r;
+}
+
+/* Advances `lfsr` by `steps` steps in O(128^2) work. */
+static inline void spring_glfsr_jump(spring_uint128 mask,
+                                     spring_uint128 *lfsr,
+                                     spring_uint128 steps) {
+  spring_uint128 r = spring_poly_xpow(steps, spring_charpoly_low(mask));
+  spring_uint128 acc = 0;
+  spring_uint128 power = *lfsr; /* A^i applied to the start state */
+  for (int i = 0; i < 128; i++) {
+    if ((r >> i) & 1U) {
+      acc ^= power;
+    }
+    spring_glfsr(mask, &power);
+  }
+  *lfsr = acc;
+}
+
+/*
+ * Advances the engine by `codewords` codewords. The control register is
+ * walked 32 steps per lookup to count how many codewords each data
+ * register produced, then both data registers jump ahead directly. The
+ * walk is 1/128th of the work of generating the skipped output.
+ */
+static inline void spring_engine_skip(SpringEngine *engine,
+                                      spring_uint128 codewords) {
+  spring_uint128 *params = engine->params;
+  spring_uint128 ones = 0;
+  spring_uint128 left = codewords;
+  for (; left >= SPRING_TABLE_STEPS; left -= SPRING_TABLE_STEPS) {
+    ones += (spring_uint128)__builtin_popcount(
+        spring_glfsr32(&engine->tables->control, &params[1]));
+  }
+  for (; left > 0; left--) {
+    ones += spring_glfsr(params[0], &params[1]);
+  }
+  spring_glfsr_jump(params[2], &params[4], (codewords - ones) * 128);
+  spring_glfsr_jump(params[3], &params[5], ones * 128);
+}
+
+/* === Library API === */
+
+typedef enum spring_status_ {
+  SPRING_OK = 0,
+  SPRING_BAD_HEX,       /* not 1 to 32 hex digits */
+  SPRING_NOT_PRIMITIVE, /* a register would not have period 2^128 - 1 */
+  SPRING_ZERO_STATE,    /* a register starts at 0 and stays there */
+} SpringStatus;
+
+static inline const char *spring_strerror(SpringStatus status) {
+  switch (status) {
+  case SPRING_OK:
+    return "ok";
+  case SPRING_BAD_HEX:
+    return "not a hex number of 1 to 32 digits";
+  case SPRING_NOT_PRIMITIVE:
+    return "feedback polynomial is not primitive";
+  case SPRING_ZERO_STATE:
+    return "start state is zero";
+  }
+  return "unknown error";
+}
+
+/*
+ * Parses 1 to 32 hex digits, with an optional 0x prefix. Any other
+ * character is an error; the original parser read it as 0xf.
+ */
+static inline SpringStatus spring_parse_hex(const char *text,
+                                            spring_uint128 *value) {
+  if (text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+    text += 2;
+  }
+  size_t len = strlen(text);
+  if (len == 0 || len > 32) {
+    return SPRING_BAD_HEX;
+  }
+  spring_uint128 r = 0;
+  for (size_t i = 0; i < len; i++) {
+    char c = text[i];
+    uint8_t digit;
+    if (c >= '0' && c <= '9') {
+      digit = (uint8_t)(c - '0');
+    } else if (c >= 'A' && c <= 'F') {
+      digit = (uint8_t)(c - 'A' + 10);
+    } else if (c >= 'a' && c <= 'f') {
+      digit = (uint8_t)(c - 'a' + 10);
+    } else {
+      return SPRING_BAD_HEX;
+    }
+    r = (r << 4) | digit;
+  }
+  *value = r;
+  return SPRING_OK;
+}
+
+/*
+ * True when the register with toggle mask `mask` runs through all 2^128 - 1
+ * non-zero states, i.e. c(x) is primitive: x^(2^128 - 1) = 1 mod c(x) and
+ * x^((2^128 - 1) / q) != 1 for every prime factor q of 2^128 - 1. About 10
+ * modular powers, a few milliseconds.
+ */
+static inline int spring_is_primitive(spring_uint128 mask) {
+  static const uint64_t factors[] = {
+      3ULL,      5ULL,       17ULL,      257ULL,
+      641ULL,    65537ULL,   274177ULL,  6700417ULL,
+      67280421310721ULL,
+  };
+  const spring_uint128 order = ~(spring_uint128)0;
+  spring_uint128 low = spring_charpoly_low(mask);
+  if (spring_poly_xpow(order, low) != 1) {
+    return 0;
+  }
+  for (size_t i = 0; i < sizeof(factors) / sizeof(factors[0]); i++) {
+    if (spring_poly_xpow(order / factors[i], low) == 1) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* Checks that all three registers have full period from their start. */
+static inline SpringStatus spring_validate(const spring_uint128 *params) {
+  if (params[1] == 0 || params[4] == 0 || params[5] == 0) {
+    return SPRING_ZERO_STATE;
+  }
+  if (!spring_is_primitive(params[0]) || !spring_is_primitive(params[2]) ||
+      !spring_is_primitive(params[3])) {
+    return SPRING_NOT_PRIMITIVE;
+  }
+  return SPRING_OK;
+}
+
+/*
+ * A keystream position. About 60KB of tables, so keep it static or on the
+ * heap. `engine` points into the object itself: copy the engine, not the
+ * whole object, to fork a second stream.
+ */
+typedef struct spring_ {
+  SpringEngine engine;
+  SpringTables tables;
+  spring_uint128 start[6]; /* parameters, for seeking */
+  uint8_t head[16];        /* last codeword, partly handed out */
+  size_t head_len;         /* its bytes still to hand out */
+} Spring;
+
+/*
+ * Prepares `gen` at offset 0 of the keystream for `params`, after
+ * validating them with `spring_validate`. Leaves `gen` unusable on error.
+ */
+static inline SpringStatus spring_init(Spring *gen,
+                                       const spring_uint128 *params) {
+  SpringStatus status = spring_validate(params);
+  if (status != SPRING_OK) {
+    return status;
+  }
+  spring_engine_init(&gen->engine, &gen->tables, params);
+  memcpy(gen->start, params, sizeof(gen->start));
+  gen->head_len = 0;
+  return SPRING_OK;
+}
+
+/* Writes the next `n` keystream bytes. Consecutive fills are contiguous. */
+static inline void spring_fill(Spring *gen, uint8_t *buf, size_t n) {
+  size_t take = gen->head_len < n ? gen->head_len : n;
+  memcpy(buf, gen->head + 16 - gen->head_len, take);
+  gen->head_len -= take;
+  buf += take;
+  n -= take;
+
+  for (; n >= 16; n -= 16, buf += 16) {
+    spring_prng_fast(&gen->engine, buf);
+  }
+  if (n > 0) {
+    spring_prng_fast(&gen->engine, gen->head);
+    memcpy(buf, gen->head, n);
+    gen->head_len = 16 - n;
+  }
+}
+
+/*
+ * Moves `gen` to byte `offset` of the keystream in O(offset / 512): each
+ * control register lookup walks past 512 bytes of output.
+ */
+static inline void spring_seek(Spring *gen, spring_uint128 offset) {
+  memcpy(gen->engine.params, gen->start, sizeof(gen->start));
+  spring_engine_skip(&gen->engine, offset / 16);
+  gen->head_len = 0;
+  size_t skip = (size_t)(offset % 16);
+  if (skip > 0) {
+    spring_prng_fast(&gen->engine, gen->head);
+    gen->head_len = 16 - skip;
+  }
+}
+
+/*
+ * Known answer tests for the args.txt parameters, from the original bitwise
+ * generator. Returns 0 when all pass, else the number of the failing test.
+ */
+static inline int spring_selftest(void) {
+  static const char *const args[6] = {
+      "80000000000000000000000000002ed0", "DEADBEEF1337B007",
+      "80000000000000000000000000002ee6", "80000000000000000000000000002f1d",
+      "1337B007BADB0072",                 "1337B007BADB0072",
+  };
+  static const uint8_t first[32] = {
+      0x56, 0x87, 0x68, 0x2b, 0x7d, 0x5a, 0xe7, 0x1a, 0x66, 0x65, 0x6f,
+      0xbb, 0xe6, 0x29, 0x8b, 0x79, 0x90, 0x6a, 0xad, 0x72, 0x49, 0xf2,
+      0xe6, 0x37, 0xb3, 0xb4, 0x23, 0xfd, 0x74, 0x38, 0x01, 0xfc,
+  };
+  static const uint8_t at_1mib[16] = {
+      0xad, 0x89, 0x9d, 0x6b, 0x31, 0x1e, 0x68, 0x19,
+      0x5b, 0x52, 0xd4, 0x97, 0x32, 0x20, 0x8b, 0x97,
+  };
+  static Spring gen;
+  spring_uint128 params[6];
+  uint8_t whole[64];
+  uint8_t parts[64];
+
+  /* 1: parsing, and rejecting what hex_strtoulll silently accepted */
+  for (int i = 0; i < 6; i++) {
+    if (spring_parse_hex(args[i], &params[i]) != SPRING_OK) {
+      return 1;
+    }
+  }
+  spring_uint128 junk;
+  if (spring_parse_hex("12g4", &junk) != SPRING_BAD_HEX ||
+      spring_parse_hex("", &junk) != SPRING_BAD_HEX ||
+      spring_parse_hex("0x", &junk) != SPRING_BAD_HEX ||
+      spring_parse_hex("100000000000000000000000000000000", &junk) !=
+          SPRING_BAD_HEX) {
+    return 1;
+  }
+
+  /* 2: validation. Flipping one mask bit makes c(1) = 0, so x + 1 | c(x) */
+  spring_uint128 bad[6];
+  memcpy(bad, params, sizeof(bad));
+  bad[2] ^= 1;
+  if (spring_validate(params) != SPRING_OK ||
+      spring_validate(bad) != SPRING_NOT_PRIMITIVE) {
+    return 2;
+  }
+  memcpy(bad, params, sizeof(bad));
+  bad[5] = 0;
+  if (spring_validate(bad) != SPRING_ZERO_STATE) {
+    return 2;
+  }
+
+  /* 3: first codewords */
+  if (spring_init(&gen, params) != SPRING_OK) {
+    return 3;
+  }
+  spring_fill(&gen, whole, 32);
+  if (memcmp(whole, first, sizeof(first)) != 0) {
+    return 3;
+  }
+
+  /* 4: the table engine matches the bitwise generator */
+  spring_uint128 slow[6];
+  memcpy(slow, params, sizeof(slow));
+  spring_seek(&gen, 0);
+  for (int word = 0; word < 256; word++) {
+    spring_uint128 cw = spring_prng(slow);
+    spring_fill(&gen, whole, 16);
+    for (int byte = 0; byte < 16; byte++) {
+      if (whole[byte] != (uint8_t)(cw >> (byte * 8))) {
+        return 4;
+      }
+    }
+  }
+
+  /* 5: jump ahead */
+  spring_seek(&gen, 1 << 20);
+  spring_fill(&gen, whole, 16);
+  if (memcmp(whole, at_1mib, sizeof(at_1mib)) != 0) {
+    return 5;
+  }
+
+  /* 6: uneven fills and seeks inside a codeword give the same bytes */
+  spring_seek(&gen, 1000);
+  spring_fill(&gen, whole, sizeof(whole));
+  spring_seek(&gen, 997);
+  spring_fill(&gen, parts, 3); /* overwritten below */
+  static const size_t sizes[] = {1, 7, 16, 17, 0, 23};
+  size_t off = 0;
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    spring_fill(&gen, parts + off, sizes[i]);
+    off += sizes[i];
+  }
+  if (memcmp(whole, parts, sizeof(whole)) != 0) {
+    return 6;
+  }
+  return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1311 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr int INT_RADIX_BASE = 10;
+
+// Relaxations improving a distance by less than this are treated as
+// floating point round-off. Trading a rate and then its reciprocal sums
+// to a weight of ~1e-16, which must not count as an arbitrage.
+constexpr double EPSILON = 1e-9;
+
+// Added to every arc weight in incremental detection, so the zero weight
+// cycles of a trade and its reciprocal stay above round-off, which is
+// ~1e-15 for potentials this size
+constexpr double ROUNDING = 1e-12;
+
+// Marks a vertex without a predecessor
+constexpr int NONE = -1;
+
+// Relaxations an update spends placing arcs unblocked by earlier updates,
+// beyond those of its own quote. The rest wait for later updates.
+constexpr long RETRY_BUDGET = 4096;
+
+/*
+=========================================================================
+Reading rate tables
+=========================================================================
+*/
+
+/**
+ * @brief read-only memory map of a whole file
+ * @note the parser reads the table in place, without copying it
+ */
+class mapped_file {
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+
+public:
+  explicit mapped_file(const string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st {};
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      perror(path.c_str());
+      exit(EXIT_FAILURE);
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+      void *map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map == MAP_FAILED) {
+        perror(path.c_str());
+        exit(EXIT_FAILURE);
+      }
+      madvise(map, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const char *>(map);
+    }
+    close(fd);
+  }
+
+  ~mapped_file() {
+    if (data_ != nullptr) {
+      munmap(const_cast<char *>(data_), size_);
+    }
+  }
+
+  mapped_file(const mapped_file &) = delete;
+  mapped_file &operator=(const mapped_file &) = delete;
+
+  string_view view() const { return {data_, size_}; }
+};
+
+/** @brief one `from to rate` line: 1 `from` buys `rate` of `to` */
+struct quote {
+  int from;
+  int to;
+  double rate;
+};
+
+/**
+ * @brief currencies by name and the quotes between them
+ * @note names live in a deque so the views keying `ids` stay valid
+ */
+struct rate_table {
+  deque<string> names{};
+  unordered_map<string_view, int> ids{};
+  vector<quote> quotes{};
+
+  /** @returns the id of currency `name`, adding it if it is new */
+  int intern(string_view name) {
+    auto found = ids.find(name);
+    if (found != ids.end()) {
+      return found->second;
+    }
+    names.emplace_back(name);
+    int id = static_cast<int>(names.size()) - 1;
+    ids.emplace(names.back(), id);
+    return id;
+  }
+
+  int size() const { return static_cast<int>(names.size()); }
+};
+
+/** @brief strips spaces and carriage returns from both ends */
+string_view trim(string_view text) {
+  while (!text.empty() && isspace(static_cast<unsigned char>(text[0]))) {
+    text.remove_prefix(1);
+  }
+  while (!text.empty() &&
+         isspace(static_cast<unsigned char>(text.back()))) {
+    text.remove_suffix(1);
+  }
+  return text;
+}
+
+/**
+ * @brief splits a `<from>\t<to>\t<rate>` line
+ * @returns `false` unless there are two names and a positive finite rate
+ */
+bool parse_quote(string_view line, string_view &from, string_view &to,
+                 double &rate) {
+  size_t first = line.find('\t');
+  size_t second = first == string_view::npos ? first
+                                             : line.find('\t', first + 1);
+  if (second == string_view::npos) {
+    return false;
+  }
+  from = trim(line.substr(0, first));
+  to = trim(line.substr(first + 1, second - first - 1));
+  string_view number = trim(line.substr(second + 1));
+  auto [end, error] =
+      from_chars(number.data(), number.data() + number.size(), rate);
+  return !from.empty() && !to.empty() && error == errc() &&
+         end == number.data() + number.size() && rate > 0 &&
+         isfinite(rate);
+}
+
+/**
+ * @brief parses the arbitrage.txt format: a currency count line, then one
+ * tab separated `from to rate` quote per line
+ * @param name file name for error messages
+ */
+rate_table parse_table(string_view text, const string &name) {
+  rate_table table{};
+  long line_no = 0;
+  while (!text.empty()) {
+    size_t end = text.find('\n');
+    string_view line = text.substr(0, end);
+    text.remove_prefix(end == string_view::npos ? text.size() : end + 1);
+    line_no++;
+
+    if (line_no == 1) {
+      // the count only sizes the tables, like the unused '9' in the
+      // racket version
+      long count = 0;
+      string_view number = trim(line);
+      auto [ptr, error] = from_chars(
+          number.data(), number.data() + number.size(), count);
+      if (error != errc() || ptr != number.data() + number.size()) {
+        cerr << name << ":1: expected the currency count" << endl;
+        exit(EXIT_FAILURE);
+      }
+      table.ids.reserve(static_cast<size_t>(max(0L, count)));
+      continue;
+    }
+    if (trim(line).empty()) {
+      continue;
+    }
+
+    string_view from;
+    string_view to;
+    double rate = 0;
+    if (!parse_quote(line, from, to, rate)) {
+      cerr << name << ":" << line_no
+           << ": expected <from>\\t<to>\\t<positive rate>" << endl;
+      exit(EXIT_FAILURE);
+    }
+    table.quotes.push_back({table.intern(from), table.intern(to), rate});
+  }
+  return table;
+}
+
+/*
+=========================================================================
+Exchange graph
+=========================================================================
+*/
+
+/**
+ * @brief compressed sparse row exchange graph over -log(rate) weights
+ * @note a route is profitable when its rates multiply to more than 1,
+ * i.e. its weights sum below 0, so arbitrage is a negative cycle. Every
+ * quote also adds its reciprocal trade back. Arcs are indexed both by
+ * source, for SPFA, and by target, for the pull based parallel relaxation
+ */
+struct graph {
+  int n = 0;
+  vector<int> out_offsets{};
+  vector<int> out_targets{};
+  vector<double> out_weights{};
+  vector<int> in_offsets{};
+  vector<int> in_sources{};
+  vector<double> in_weights{};
+
+  graph() = default;
+
+  explicit graph(const rate_table &table) : n(table.size()) {
+    struct arc {
+      int from;
+      int to;
+      double weight;
+    };
+    vector<arc> arcs{};
+    arcs.reserve(2 * table.quotes.size());
+    for (const quote &q : table.quotes) {
+      arcs.push_back({q.from, q.to, -log(q.rate)});
+      arcs.push_back({q.to, q.from, log(q.rate)});
+    }
+
+    out_offsets.assign(n + 1, 0);
+    in_offsets.assign(n + 1, 0);
+    for (const arc &a : arcs) {
+      out_offsets[a.from + 1]++;
+      in_offsets[a.to + 1]++;
+    }
+    for (int v = 0; v < n; v++) {
+      out_offsets[v + 1] += out_offsets[v];
+      in_offsets[v + 1] += in_offsets[v];
+    }
+
+    out_targets.resize(arcs.size());
+    out_weights.resize(arcs.size());
+    in_sources.resize(arcs.size());
+    in_weights.resize(arcs.size());
+    vector<int> out_next(out_offsets.begin(), out_offsets.end() - 1);
+    vector<int> in_next(in_offsets.begin(), in_offsets.end() - 1);
+    for (const arc &a : arcs) {
+      int o = out_next[a.from]++;
+      out_targets[o] = a.to;
+      out_weights[o] = a.weight;
+      int i = in_next[a.to]++;
+      in_sources[i] = a.from;
+      in_weights[i] = a.weight;
+    }
+  }
+
+  size_t arcs() const { return out_targets.size(); }
+
+  /** @returns the lightest weight of an arc from `u` to `v` */
+  double weight(int u, int v) const {
+    double best = INFINITY;
+    for (int a = out_offsets[u]; a < out_offsets[u + 1]; a++) {
+      if (out_targets[a] == v) {
+        best = min(best, out_weights[a]);
+      }
+    }
+    return best;
+  }
+
+  /** @returns total weight of trading around `cycle` back to its start */
+  double cycle_weight(const vector<int> &cycle) const {
+    double total = 0;
+    for (size_t i = 0; i < cycle.size(); i++) {
+      total += weight(cycle[i], cycle[(i + 1) % cycle.size()]);
+    }
+    return total;
+  }
+};
+
+/*
+=========================================================================
+Negative cycle detection
+=========================================================================
+*/
+
+/**
+ * @brief finds a cycle among predecessor links in O(n)
+ * @note while distances only decrease, any such cycle is negative
+ * @returns the cycle in trading order, or empty if `pred` is a forest
+ */
+vector<int> find_cycle(const vector<int> &pred) {
+  int n = static_cast<int>(pred.size());
+  vector<int> stamp(n, NONE);
+  for (int root = 0; root < n; root++) {
+    int v = root;
+    while (v != NONE && stamp[v] == NONE) {
+      stamp[v] = root;
+      v = pred[v];
+    }
+    if (v == NONE || stamp[v] != root) {
+      continue;
+    }
+
+    // v is on a cycle first reached from this root. pred links point
+    // backwards along trades, so walk them and reverse.
+    vector<int> cycle{v};
+    for (int u = pred[v]; u != v; u = pred[u]) {
+      cycle.push_back(u);
+    }
+    reverse(cycle.begin(), cycle.end());
+    return cycle;
+  }
+  return {};
+}
+
+/** @brief a found cycle if it really is an arbitrage, else empty */
+vector<int> negative_cycle(const graph &g, const vector<int> &pred) {
+  vector<int> cycle = find_cycle(pred);
+  if (!cycle.empty() && g.cycle_weight(cycle) < -EPSILON) {
+    return cycle;
+  }
+  return {};
+}
+
+/**
+ * @brief shortest path faster algorithm (queue based Bellman-Ford) from a
+ * virtual source joined to every currency by a 0 weight arc
+ * @note exits as soon as a negative cycle shows in the predecessor links,
+ * checked every n relaxations, or when no distance changes
+ * @returns an arbitrage cycle, or empty if there is none
+ */
+vector<int> spfa(const graph &g) {
+  const int n = g.n;
+  vector<double> dist(n, 0.0);
+  vector<int> pred(n, NONE);
+  vector<int> length(n, 0);
+  vector<char> queued(n, 1);
+
+  // every vertex is queued at most once, so a ring of n slots suffices
+  vector<int> ring(n);
+  for (int v = 0; v < n; v++) {
+    ring[v] = v;
+  }
+  size_t head = 0;
+  size_t count = n;
+  long relaxed = 0;
+
+  while (count > 0) {
+    int u = ring[head];
+    head = (head + 1) % n;
+    count--;
+    queued[u] = 0;
+
+    for (int a = g.out_offsets[u]; a < g.out_offsets[u + 1]; a++) {
+      int v = g.out_targets[a];
+      double candidate = dist[u] + g.out_weights[a];
+      if (candidate >= dist[v] - EPSILON) {
+        continue;
+      }
+      dist[v] = candidate;
+      pred[v] = u;
+      length[v] = length[u] + 1;
+
+      // a shortest path of n arcs repeats a vertex, so preds have a cycle
+      if (length[v] >= n || ++relaxed % n == 0) {
+        vector<int> cycle = negative_cycle(g, pred);
+        if (!cycle.empty()) {
+          return cycle;
+        }
+      }
+      if (!queued[v]) {
+        queued[v] = 1;
+        ring[(head + count) % n] = v;
+        count++;
+      }
+    }
+  }
+  return {};
+}
+
+/**
+ * @brief reusable barrier where the last thread to arrive runs `step`
+ * before any thread is released
+ */
+class barrier {
+  mutex lock_;
+  condition_variable released_;
+  unsigned threads_;
+  unsigned waiting_ = 0;
+  unsigned long generation_ = 0;
+
+public:
+  explicit barrier(unsigned threads) : threads_(threads) {}
+
+  void arrive_and_wait(const function<void()> &step) {
+    unique_lock<mutex> hold(lock_);
+    unsigned long generation = generation_;
+    if (++waiting_ == threads_) {
+      step();
+      waiting_ = 0;
+      generation_++;
+      released_.notify_all();
+      return;
+    }
+    released_.wait(hold, [&] { return generation_ != generation; });
+  }
+};
+
+/**
+ * @brief Bellman-Ford with every round's relaxation split across threads
+ * @note each thread owns a range of vertices, balanced by arcs, and pulls
+ * its new distances from the previous round's, so rounds need no atomics.
+ * Stops early once a round changes nothing or the predecessor links hold
+ * a negative cycle, checked after every round.
+ * @param rounds set to the number of rounds run
+ * @returns an arbitrage cycle, or empty if there is none
+ */
+vector<int> parallel_bellman_ford(const graph &g, unsigned threads,
+                                  int &rounds) {
+  const int n = g.n;
+  vector<double> dist(n, 0.0);
+  vector<double> next(n, 0.0);
+  vector<int> pred(n, NONE);
+  vector<int> cycle{};
+  atomic<bool> changed{false};
+  bool done = n == 0;
+  rounds = 0;
+
+  threads = max(1U, min<unsigned>(threads, max(1, n)));
+  vector<int> bounds{0};
+  for (unsigned t = 1; t < threads; t++) {
+    // first vertex past the t-th share of incoming arcs
+    int share = static_cast<int>(g.arcs() * t / threads);
+    bounds.push_back(static_cast<int>(
+        upper_bound(g.in_offsets.begin(), g.in_offsets.end() - 1, share) -
+        g.in_offsets.begin() - 1));
+    bounds.back() = max(bounds.back(), bounds[t - 1]);
+  }
+  bounds.push_back(n);
+
+  double *current = dist.data();
+  double *updated = next.data();
+  barrier sync(threads);
+
+  auto end_round = [&]() {
+    swap(current, updated);
+    rounds++;
+    if (!changed.load(memory_order_relaxed)) {
+      done = true;
+      return;
+    }
+    changed.store(false, memory_order_relaxed);
+    cycle = negative_cycle(g, pred);
+    done = !cycle.empty() || rounds >= n;
+  };
+
+  auto worker = [&](unsigned id) {
+    while (!done) {
+      bool any = false;
+      for (int v = bounds[id]; v < bounds[id + 1]; v++) {
+        double best = current[v];
+        int from = NONE;
+        for (int a = g.in_offsets[v]; a < g.in_offsets[v + 1]; a++) {
+          double candidate = current[g.in_sources[a]] + g.in_weights[a];
+          if (candidate < best - EPSILON) {
+            best = candidate;
+            from = g.in_sources[a];
+          }
+        }
+        updated[v] = best;
+        if (from != NONE) {
+          pred[v] = from;
+          any = true;
+        }
+      }
+      if (any) {
+        changed.store(true, memory_order_relaxed);
+      }
+      sync.arrive_and_wait(end_round);
+    }
+  };
+
+  vector<thread> pool;
+  for (unsigned id = 1; id < threads; id++) {
+    pool.emplace_back(worker, id);
+  }
+  worker(0);
+  for (auto &t : pool) {
+    t.join();
+  }
+
+  if (cycle.empty() && rounds >= n && n > 0) {
+    // n rounds still relaxing means a cycle the pred check rounded away
+    cycle = negative_cycle(g, pred);
+  }
+  return cycle;
+}
+
+/*
+=========================================================================
+Incremental detection on streaming updates
+=========================================================================
+*/
+
+/**
+ * @brief exchange graph kept free of negative cycles under rate updates
+ * @note every currency keeps a potential with dist[v] <= dist[u] + w for
+ * each active arc u -> v, which proves the active arcs have no negative
+ * cycle. Raising a weight keeps that true. Lowering one can only break it
+ * at that arc, so relaxing outwards from its head finds either new
+ * potentials or, once it would lower the arc's own tail, a negative cycle
+ * through it. That touches only the vertices whose potential changes.
+ * Potentials compare exactly against each weight plus ROUNDING, so they
+ * prove the active graph free of negative cycles under those weights,
+ * and a search only ever circles a cycle closed by the new arc. An arc
+ * closing a cycle is blocked, left out of the active graph, while that
+ * witness cycle stays negative. Updates to its arcs re-sum it, and only
+ * once it is not negative is the arc placed again, within a budget of
+ * relaxations per update; the rest wait for later updates. Only cycles
+ * below -EPSILON are reported as arbitrage; lighter ones come from
+ * rounding the rates. While an arc is blocked, other cycles through it
+ * are not reported again. Loading adds the quotes one at a time the same
+ * way, so it slows down with the amount of arbitrage in the table.
+ */
+class market {
+  struct arc {
+    int from;
+    int to;
+    double weight;
+    bool active;
+  };
+
+  rate_table &table_;
+  vector<arc> arcs_{};
+  vector<vector<int>> out_{};
+  // quote_key(from, to) -> its arc; the reciprocal arc follows it
+  unordered_map<uint64_t, int> quotes_{};
+  vector<double> dist_{};
+  vector<int> pred_{};
+  vector<vector<int>> in_{};
+  // arcs on the path of lowered potentials from the activated arc
+  vector<int> length_{};
+  // potentials before this attempt, of the vertices it lowered
+  vector<double> before_{};
+  vector<unsigned> saved_{};
+  vector<int> undo_{};
+  // lowered vertices by how far they dropped, largest first
+  vector<pair<double, int>> ahead_{};
+  // least reduced cost from each vertex to the activated arc's tail, and
+  // the arc that starts it, for vertices `reached_` in this attempt
+  vector<double> reach_{};
+  vector<int> succ_{};
+  vector<unsigned> reached_{};
+  // vertices by reduced cost to the tail, nearest first
+  vector<pair<double, int>> behind_{};
+  vector<unsigned> seen_{};
+  vector<size_t> at_{};
+  unsigned walk_ = 0;
+  unsigned attempt_ = 0;
+  // relaxations by every search so far, to meter deferred placements
+  long relaxed_ = 0;
+  // arcs of the cycle blocking an arc, as a rule through it; empty if
+  // the arc is active or deferred
+  vector<vector<int>> witness_{};
+  // blocked arcs whose witness runs through an arc, each with the index
+  // of the arc in that witness
+  vector<vector<pair<int, int>>> watchers_{};
+  // where the arcs of an arc's witness list it in `watchers_`
+  vector<vector<int>> slots_{};
+  // arcs waiting for `place`, in order; stale once `waiting_` is unset
+  deque<int> pending_{};
+  vector<char> waiting_{};
+  vector<unsigned> checked_{};
+  unsigned update_ = 0;
+
+  static uint64_t quote_key(int from, int to) {
+    return (static_cast<uint64_t>(from) << 32) | static_cast<uint32_t>(to);
+  }
+
+  void grow() {
+    size_t n = table_.names.size();
+    out_.resize(n);
+    in_.resize(n);
+    dist_.resize(n, 0.0);
+    pred_.resize(n, NONE);
+    length_.resize(n, 0);
+    before_.resize(n, 0.0);
+    saved_.resize(n, 0);
+    reach_.resize(n, 0.0);
+    succ_.resize(n, NONE);
+    reached_.resize(n, 0);
+    seen_.resize(n, 0);
+    at_.resize(n, 0);
+  }
+
+  /** @brief potential of `v` before this attempt */
+  double old(int v) const {
+    return saved_[v] == attempt_ ? before_[v] : dist_[v];
+  }
+
+  /** @brief how far this attempt lowered the potential of `v` */
+  double drop(int v) const {
+    return saved_[v] == attempt_ ? before_[v] - dist_[v] : 0;
+  }
+
+  void lower(int v, double distance, int via, int length) {
+    if (saved_[v] != attempt_) {
+      saved_[v] = attempt_;
+      before_[v] = dist_[v];
+      undo_.push_back(v);
+    }
+    dist_[v] = distance;
+    pred_[v] = via;
+    length_[v] = length;
+    relaxed_++;
+    ahead_.emplace_back(before_[v] - distance, v);
+    push_heap(ahead_.begin(), ahead_.end());
+  }
+
+  void reach(int v, double cost, int via) {
+    reached_[v] = attempt_;
+    reach_[v] = cost;
+    succ_[v] = via;
+    relaxed_++;
+    behind_.emplace_back(cost, v);
+    push_heap(behind_.begin(), behind_.end(), greater<>());
+  }
+
+  /**
+   * @brief a cycle among the pred links of potentials lowered in this
+   * attempt, walking back from `v`
+   * @returns its arcs in trading order, or empty if there is none
+   */
+  vector<int> pred_cycle(int v) {
+    walk_++;
+    while (saved_[v] == attempt_ && seen_[v] != walk_) {
+      seen_[v] = walk_;
+      v = arcs_[pred_[v]].from;
+    }
+    if (saved_[v] != attempt_) {
+      return {};
+    }
+    vector<int> cycle{pred_[v]};
+    for (int u = arcs_[pred_[v]].from; u != v; u = arcs_[pred_[u]].from) {
+      cycle.push_back(pred_[u]);
+    }
+    reverse(cycle.begin(), cycle.end());
+    return cycle;
+  }
+
+  /**
+   * @brief the cycle through `a` joining the lowered path from its head
+   * to `v` with the reached path from `v` to its tail
+   * @note where the two paths cross, the loop between is cut out. Its
+   * reduced costs are not negative, so the cycle only gets lighter.
+   * @returns its arcs in trading order, or empty if the pred links loop
+   */
+  vector<int> meet_cycle(int a, int v) {
+    const int head = arcs_[a].to;
+    vector<int> cycle{};
+    for (int u = v; u != head; u = arcs_[pred_[u]].from) {
+      if (cycle.size() >= dist_.size()) {
+        return {};
+      }
+      cycle.push_back(pred_[u]);
+    }
+    cycle.push_back(a);
+    reverse(cycle.begin(), cycle.end());
+
+    // at_[u] is the index of the arc into u, for vertices seen on it
+    walk_++;
+    for (size_t i = 0; i < cycle.size(); i++) {
+      seen_[arcs_[cycle[i]].to] = walk_;
+      at_[arcs_[cycle[i]].to] = i;
+    }
+    auto on_cycle = [&](int u) {
+      return seen_[u] == walk_ && at_[u] < cycle.size() &&
+             arcs_[cycle[at_[u]]].to == u;
+    };
+    for (int u = v; u != arcs_[a].from;) {
+      int b = succ_[u];
+      u = arcs_[b].to;
+      if (on_cycle(u)) {
+        cycle.resize(at_[u] + 1);
+        continue;
+      }
+      cycle.push_back(b);
+      seen_[u] = walk_;
+      at_[u] = cycle.size() - 1;
+    }
+    return cycle;
+  }
+
+  /**
+   * @brief adds arc `a` to the active graph, relaxing potentials from it
+   * @note a search backwards from the tail of `a` over reduced costs
+   * runs alongside, only as far as the largest drop still to come. A
+   * vertex lowered by more than its reduced cost to the tail closes a
+   * cycle, found without lowering the tail itself.
+   * @returns empty on success, else the negative cycle it would close,
+   * with the potentials rolled back
+   */
+  vector<int> activate(int a) {
+    const arc &added = arcs_[a];
+    if (dist_[added.from] + added.weight + ROUNDING >= dist_[added.to]) {
+      arcs_[a].active = true;
+      return {};
+    }
+
+    attempt_++;
+    undo_.clear();
+    ahead_.clear();
+    behind_.clear();
+    const int n = static_cast<int>(dist_.size());
+    lower(added.to, dist_[added.from] + added.weight + ROUNDING, a, 1);
+    reach(added.from, 0, NONE);
+    size_t forward = 0;
+    size_t backward = 0;
+    vector<int> witness{};
+
+    // a vertex both lowered and reached closes a cycle through `a`
+    auto meets = [&](int v) {
+      if (reached_[v] == attempt_ && reach_[v] < drop(v)) {
+        witness = meet_cycle(a, v);
+        if (!witness.empty() && !closes(witness)) {
+          witness.clear(); // round-off, the forward search decides
+        }
+      }
+      return !witness.empty();
+    };
+
+    while (!ahead_.empty() && witness.empty()) {
+      // no vertex can drop by more than the forward search's top
+      if (!behind_.empty() && behind_.front().first < ahead_.front().first &&
+          backward <= forward) {
+        auto [cost, u] = behind_.front();
+        pop_heap(behind_.begin(), behind_.end(), greater<>());
+        behind_.pop_back();
+        if (cost != reach_[u]) {
+          continue; // reached again since, more cheaply
+        }
+        backward++;
+        for (int b : in_[u]) {
+          const arc &prev = arcs_[b];
+          int x = prev.from;
+          if (!prev.active) {
+            continue;
+          }
+          double reduced = old(x) + prev.weight + ROUNDING - old(u);
+          double total = cost + max(0.0, reduced);
+          if (reached_[x] == attempt_ && total >= reach_[x]) {
+            continue;
+          }
+          reach(x, total, b);
+          if (meets(x)) {
+            break;
+          }
+        }
+        continue;
+      }
+
+      auto [dropped, u] = ahead_.front();
+      pop_heap(ahead_.begin(), ahead_.end());
+      ahead_.pop_back();
+      if (dropped != drop(u)) {
+        continue; // lowered again since, by more
+      }
+      forward++;
+      for (int b : out_[u]) {
+        const arc &next = arcs_[b];
+        double candidate = dist_[u] + next.weight + ROUNDING;
+        if (!next.active || candidate >= dist_[next.to]) {
+          continue;
+        }
+        lower(next.to, candidate, b, length_[u] + 1);
+        if (next.to == added.from) {
+          // the pred links from u lead back through `added`, unless they
+          // run into another cycle first
+          witness = pred_cycle(added.from);
+          break;
+        }
+
+        // a path of n arcs repeats a vertex, so the preds hold a cycle.
+        // The potentials rule out one that `added` is not on, but stop
+        // there rather than ever circle it
+        if (length_[next.to] >= n) {
+          witness = pred_cycle(next.to);
+          if (!witness.empty()) {
+            break;
+          }
+        }
+        if (meets(next.to)) {
+          break;
+        }
+      }
+    }
+
+    if (witness.empty()) {
+      arcs_[a].active = true;
+      return witness;
+    }
+    for (int v : undo_) {
+      dist_[v] = before_[v];
+    }
+    return witness;
+  }
+
+  /** @brief lists blocked arc `a` as a watcher of its witness arcs */
+  void watch(int a) {
+    const vector<int> &witness = witness_[a];
+    slots_[a].resize(witness.size());
+    for (size_t i = 0; i < witness.size(); i++) {
+      vector<pair<int, int>> &list = watchers_[witness[i]];
+      slots_[a][i] = static_cast<int>(list.size());
+      list.emplace_back(a, static_cast<int>(i));
+    }
+  }
+
+  /** @brief clears the witness of `a`, dropping each of its watches */
+  void unwatch(int a) {
+    const vector<int> &witness = witness_[a];
+    for (size_t i = 0; i < witness.size(); i++) {
+      vector<pair<int, int>> &list = watchers_[witness[i]];
+      int slot = slots_[a][i];
+      list[slot] = list.back();
+      slots_[list[slot].first][list[slot].second] = slot;
+      list.pop_back();
+    }
+    witness_[a].clear();
+    slots_[a].clear();
+  }
+
+  /** @brief a witness is still a cycle the potentials cannot allow */
+  bool closes(const vector<int> &witness) const {
+    return weight(witness) + witness.size() * ROUNDING < 0;
+  }
+
+  /**
+   * @brief activates `a` or blocks it, collecting the cycle found if it
+   * is an arbitrage
+   */
+  void place(int a, vector<vector<int>> &cycles) {
+    vector<int> witness = activate(a);
+    if (witness.empty()) {
+      return;
+    }
+    if (weight(witness) < -EPSILON) {
+      cycles.push_back(witness);
+    }
+    witness_[a] = move(witness);
+    watch(a);
+  }
+
+  void defer(int a) {
+    if (!waiting_[a]) {
+      waiting_[a] = 1;
+      pending_.push_back(a);
+    }
+  }
+
+  /** @brief places deferred arcs until `budget` relaxations are spent */
+  void drain(long budget, vector<vector<int>> &cycles) {
+    long start = relaxed_;
+    while (!pending_.empty() && relaxed_ - start < budget) {
+      int a = pending_.front();
+      pending_.pop_front();
+      if (waiting_[a]) {
+        waiting_[a] = 0;
+        place(a, cycles);
+      }
+    }
+  }
+
+public:
+  explicit market(rate_table &table) : table_(table) {
+    grow();
+    vector<vector<int>> ignored{};
+    for (const quote &q : table.quotes) {
+      add_quote(q.from, q.to, q.rate, ignored);
+    }
+  }
+
+  /** @brief arbitrage cycles blocking arcs, as arcs in trading order */
+  vector<vector<int>> standing() const {
+    vector<vector<int>> cycles{};
+    for (const vector<int> &witness : witness_) {
+      if (!witness.empty() && weight(witness) < -EPSILON) {
+        cycles.push_back(witness);
+      }
+    }
+    return cycles;
+  }
+
+  /** @brief number of arcs currently left out as closing an arbitrage */
+  size_t blocked() const {
+    return count_if(witness_.begin(), witness_.end(),
+                    [this](const vector<int> &witness) {
+                      return !witness.empty() && weight(witness) < -EPSILON;
+                    });
+  }
+
+  /** @brief number of arcs whose placement is deferred to later updates */
+  size_t deferred() const {
+    return count(waiting_.begin(), waiting_.end(), 1);
+  }
+
+  /** @brief currencies visited by a cycle of arcs */
+  vector<int> route(const vector<int> &cycle) const {
+    vector<int> currencies{};
+    for (int a : cycle) {
+      currencies.push_back(arcs_[a].from);
+    }
+    return currencies;
+  }
+
+  /** @brief total weight of a cycle of arcs */
+  double weight(const vector<int> &cycle) const {
+    double total = 0;
+    for (int a : cycle) {
+      total += arcs_[a].weight;
+    }
+    return total;
+  }
+
+  /** @brief adds a quote and its reciprocal trade */
+  void add_quote(int from, int to, double rate,
+                 vector<vector<int>> &cycles) {
+    int a = static_cast<int>(arcs_.size());
+    quotes_[quote_key(from, to)] = a;
+    arcs_.push_back({from, to, -log(rate), false});
+    arcs_.push_back({to, from, log(rate), false});
+    witness_.resize(arcs_.size());
+    watchers_.resize(arcs_.size());
+    slots_.resize(arcs_.size());
+    waiting_.resize(arcs_.size(), 0);
+    checked_.resize(arcs_.size(), 0);
+    out_[from].push_back(a);
+    out_[to].push_back(a + 1);
+    in_[to].push_back(a);
+    in_[from].push_back(a + 1);
+    place(a, cycles);
+    place(a + 1, cycles);
+  }
+
+  /**
+   * @brief sets the rate of quote `from` -> `to`, adding it if it is new
+   * @returns the negative cycles, as arcs, found while re-checking
+   */
+  vector<vector<int>> update(string_view from, string_view to,
+                             double rate) {
+    int u = table_.intern(from);
+    int v = table_.intern(to);
+    grow();
+
+    vector<vector<int>> cycles{};
+    auto found = quotes_.find(quote_key(u, v));
+    if (found == quotes_.end()) {
+      add_quote(u, v, rate, cycles);
+      return cycles;
+    }
+
+    // blocked arcs in the quote or with it on their witness, with the
+    // witness weight before the update
+    int first = found->second;
+    vector<pair<int, double>> rechecks{};
+    update_++;
+    auto note = [&](int b) {
+      if (checked_[b] != update_ && !witness_[b].empty()) {
+        checked_[b] = update_;
+        rechecks.emplace_back(b, weight(witness_[b]));
+      }
+    };
+    for (int a = first; a < first + 2; a++) {
+      note(a);
+      for (auto [b, at] : watchers_[a]) {
+        note(b);
+      }
+    }
+
+    // raising weights keeps the potentials valid, so apply both first
+    double weights[2] = {-log(rate), log(rate)};
+    vector<int> retry{};
+    for (int a = first; a < first + 2; a++) {
+      double old = arcs_[a].weight;
+      arcs_[a].weight = weights[a - first];
+      if (arcs_[a].active && arcs_[a].weight < old) {
+        arcs_[a].active = false;
+        retry.push_back(a);
+      }
+    }
+
+    // a blocked arc stays blocked while its witness is still negative,
+    // and is reported if that only now makes it an arbitrage
+    for (auto [b, before] : rechecks) {
+      if (closes(witness_[b])) {
+        if (weight(witness_[b]) < -EPSILON && before >= -EPSILON) {
+          cycles.push_back(witness_[b]);
+        }
+        continue;
+      }
+      unwatch(b);
+      defer(b);
+    }
+
+    // the quote's own arcs are placed now, others within the budget
+    for (int a = first; a < first + 2; a++) {
+      if (waiting_[a]) {
+        waiting_[a] = 0;
+        retry.push_back(a);
+      }
+    }
+    for (int a : retry) {
+      place(a, cycles);
+    }
+    drain(RETRY_BUDGET, cycles);
+    return cycles;
+  }
+};
+
+/*
+=========================================================================
+Driver
+=========================================================================
+*/
+
+/** @brief prints a cycle like the racket version, starting at Dollar */
+void show_route(const rate_table &table, vector<int> cycle,
+                double weight) {
+  auto start = table.ids.find("Dollar");
+  if (start != table.ids.end()) {
+    auto at = find(cycle.begin(), cycle.end(), start->second);
+    if (at != cycle.end()) {
+      rotate(cycle.begin(), at, cycle.end());
+    }
+  }
+  for (int v : cycle) {
+    cout << table.names[v] << " --> ";
+  }
+  cout << table.names[cycle.front()] << "  x" << setprecision(8)
+       << exp(-weight) << "\n";
+}
+
+/**
+ * @brief writes a random table of `n` currencies in the arbitrage.txt
+ * format, for benchmarks
+ * @param degree quotes per currency
+ * @param noise relative error added to consistent rates. 0 gives a table
+ * without arbitrage, the worst case for early exit
+ */
+void generate(int n, int degree, double noise) {
+  mt19937_64 rng(n);
+  normal_distribution<double> price(0, 2);
+  uniform_real_distribution<double> jitter(-noise, noise);
+  uniform_int_distribution<int> pick(0, n - 1);
+
+  vector<double> log_price(n);
+  for (double &p : log_price) {
+    p = price(rng);
+  }
+  cout << n << "\n" << setprecision(17);
+  for (int u = 0; u < n; u++) {
+    for (int d = 0; d < degree; d++) {
+      int v = pick(rng);
+      if (v == u) {
+        continue;
+      }
+      double rate = exp(log_price[u] - log_price[v]) * (1 + jitter(rng));
+      cout << "C" << u << "\tC" << v << "\t" << rate << "\n";
+    }
+  }
+}
+
+double seconds_since(steady_clock::time_point start) {
+  return duration<double>(steady_clock::now() - start).count();
+}
+
+/**
+ * @brief loads the table once, then applies `from to rate` updates from
+ * stdin, printing the arbitrage cycles each one reveals as soon as found
+ */
+void serve(rate_table &table) {
+  ios::sync_with_stdio(false);
+  market live(table);
+  for (const vector<int> &cycle : live.standing()) {
+    show_route(table, live.route(cycle), live.weight(cycle));
+  }
+  cout << flush;
+
+  string line;
+  long line_no = 0;
+  long updates = 0;
+  long reports = 0;
+  double total = 0;
+  double worst = 0;
+  while (getline(cin, line)) {
+    line_no++;
+    string_view from;
+    string_view to;
+    double rate = 0;
+    if (trim(line).empty()) {
+      continue;
+    }
+    if (!parse_quote(line, from, to, rate)) {
+      cerr << "stdin:" << line_no
+           << ": expected <from>\\t<to>\\t<positive rate>" << endl;
+      continue;
+    }
+
+    auto start = steady_clock::now();
+    vector<vector<int>> cycles = live.update(from, to, rate);
+    double latency = seconds_since(start);
+    for (const vector<int> &cycle : cycles) {
+      show_route(table, live.route(cycle), live.weight(cycle));
+    }
+    if (!cycles.empty()) {
+      cout << flush;
+    }
+    updates++;
+    reports += static_cast<long>(cycles.size());
+    total += latency;
+    worst = max(worst, latency);
+  }
+
+  cerr << updates << " updates, " << reports << " cycles reported, "
+       << live.blocked() << " trades blocked by arbitrage, "
+       << live.deferred() << " still to re-check" << endl;
+  if (updates > 0) {
+    cerr << "latency: mean " << total / updates * 1e6 << "us, max "
+         << worst * 1e6 << "us" << endl;
+  }
+}
+
+/**
+ * @brief replays `count` random updates of existing quotes, each moved by
+ * up to `noise` relative, and reports updates/sec against re-running the
+ * whole detection
+ */
+void replay(rate_table &table, long count, double noise) {
+  if (table.quotes.empty()) {
+    cerr << "replay needs a table with quotes" << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  auto start = steady_clock::now();
+  graph whole(table);
+  vector<int> found = spfa(whole);
+  double full = seconds_since(start);
+
+  start = steady_clock::now();
+  market live(table);
+  double load = seconds_since(start);
+  size_t blocked = live.blocked();
+
+  struct change {
+    int quote;
+    double rate;
+  };
+  mt19937_64 rng(count);
+  uniform_int_distribution<size_t> pick(0, table.quotes.size() - 1);
+  uniform_real_distribution<double> jitter(-noise, noise);
+  vector<change> changes{};
+  for (long i = 0; i < count; i++) {
+    size_t q = pick(rng);
+    changes.push_back(
+        {static_cast<int>(q), table.quotes[q].rate * (1 + jitter(rng))});
+  }
+
+  vector<double> latencies{};
+  latencies.reserve(changes.size());
+  long reports = 0;
+  start = steady_clock::now();
+  for (const change &c : changes) {
+    const quote &q = table.quotes[c.quote];
+    auto begin = steady_clock::now();
+    reports += static_cast<long>(
+        live.update(table.names[q.from], table.names[q.to], c.rate)
+            .size());
+    latencies.push_back(seconds_since(begin));
+  }
+  double elapsed = seconds_since(start);
+  sort(latencies.begin(), latencies.end());
+
+  cout << table.size() << " currencies, " << table.quotes.size()
+       << " quotes" << endl;
+  cout << "full re-detection: " << full * 1e3 << "ms"
+       << (found.empty() ? ", no arbitrage" : ", found arbitrage") << endl;
+  cout << "incremental load:  " << load * 1e3 << "ms, " << blocked
+       << " trades blocked by arbitrage" << endl;
+  cout << "Affter " << count << " updates: "
+       << static_cast<long>(count / elapsed) << " updates/sec, "
+       << reports << " cycles reported, " << live.blocked()
+       << " trades blocked, " << live.deferred() << " deferred" << endl;
+  cout << "latency: median " << latencies[latencies.size() / 2] * 1e6
+       << "us, p99 " << latencies[latencies.size() * 99 / 100] * 1e6
+       << "us, max " << latencies.back() * 1e6 << "us" << endl;
+}
+
+int main(int argc, char *argv[]) {
+  string path = "./arbitrage.txt";
+  bool use_spfa = true;
+  bool bench = false;
+  bool serving = false;
+  long replays = 0;
+  double replay_noise = 0.001;
+  unsigned threads = max(1U, thread::hardware_concurrency());
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--spfa") {
+      use_spfa = true;
+    } else if (arg == "--parallel") {
+      use_spfa = false;
+    } else if (arg == "--bench") {
+      bench = true;
+    } else if (arg == "--serve") {
+      serving = true;
+    } else if (arg == "--replay" && i + 1 < argc) {
+      replays = max(1L, strtol(argv[++i], nullptr, INT_RADIX_BASE));
+      if (i + 1 < argc && argv[i + 1][0] != '-' &&
+          strtod(argv[i + 1], nullptr) > 0) {
+        replay_noise = strtod(argv[++i], nullptr);
+      }
+    } else if (arg == "--threads" && i + 1 < argc) {
+      threads = max(1L, strtol(argv[++i], nullptr, INT_RADIX_BASE));
+    } else if (arg == "--generate" && i + 1 < argc) {
+      int n = strtol(argv[++i], nullptr, INT_RADIX_BASE);
+      int degree = i + 1 < argc ? strtol(argv[++i], nullptr, INT_RADIX_BASE)
+                                : 16;
+      double noise = i + 1 < argc ? strtod(argv[++i], nullptr) : 0.001;
+      generate(max(2, n), max(1, degree), noise);
+      return 0;
+    } else if (arg.rfind("--", 0) == 0) {
+      cerr << "Usage: " << argv[0]
+           << " [--spfa | --parallel] [--threads n] [--bench] [table]"
+           << endl;
+      cerr << "       " << argv[0] << " --serve [table] < updates" << endl;
+      cerr << "       " << argv[0] << " --replay n [noise] [table]"
+           << endl;
+      cerr << "       " << argv[0] << " --generate n [degree [noise]]"
+           << endl;
+      cerr << "  table defaults to ./arbitrage.txt" << endl;
+      exit(EXIT_FAILURE);
+    } else {
+      path = arg;
+    }
+  }
+
+  auto start = steady_clock::now();
+  mapped_file file(path);
+  rate_table table = parse_table(file.view(), path);
+  double parse_time = seconds_since(start);
+
+  if (serving) {
+    serve(table);
+    return 0;
+  }
+  if (replays > 0) {
+    replay(table, replays, replay_noise);
+    return 0;
+  }
+
+  start = steady_clock::now();
+  graph g(table);
+  double build_time = seconds_since(start);
+
+  vector<int> cycle{};
+  if (bench) {
+    cout << table.size() << " currencies, " << table.quotes.size()
+         << " quotes" << endl;
+    cout << "parse:    " << parse_time << "s" << endl;
+    cout << "csr:      " << build_time << "s" << endl;
+
+    start = steady_clock::now();
+    cycle = spfa(g);
+    cout << "spfa:     " << seconds_since(start) << "s"
+         << (cycle.empty() ? ", no arbitrage" : ", found arbitrage")
+         << endl;
+
+    int rounds = 0;
+    start = steady_clock::now();
+    vector<int> parallel = parallel_bellman_ford(g, threads, rounds);
+    cout << "parallel: " << seconds_since(start) << "s on " << threads
+         << " threads, " << rounds << " rounds"
+         << (parallel.empty() ? ", no arbitrage" : ", found arbitrage")
+         << endl;
+  } else if (use_spfa) {
+    cycle = spfa(g);
+  } else {
+    int rounds = 0;
+    cycle = parallel_bellman_ford(g, threads, rounds);
+  }
+
+  if (cycle.empty()) {
+    cout << "no arbitrage" << endl;
+    return 0;
+  }
+  show_route(table, cycle, g.cycle_weight(cycle));
+}